@@ -0,0 +1,85 @@
+// Frame arena, see arena.h
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+
+// Every piece is aligned to this many bytes
+#define ARENA_ALIGN 16
+
+typedef struct ArenaBlock {
+	// The block that was full before this one was added
+	struct ArenaBlock* last;
+	size_t size, used;
+	_Alignas(ARENA_ALIGN) char data[];
+} ArenaBlock;
+
+struct Arena {
+	// The block pieces are taken from, earlier blocks are only freed by the reset
+	ArenaBlock* block;
+};
+
+ArenaBlock* arena_block(size_t size, ArenaBlock* last) {
+	ArenaBlock* block = malloc(sizeof(ArenaBlock) + size);
+	block->last = last;
+	block->size = size;
+	block->used = 0;
+	return block;
+}
+
+Arena* arena_create(size_t size) {
+	Arena* arena = malloc(sizeof(Arena));
+	arena->block = arena_block(size, NULL);
+	return arena;
+}
+
+void arena_free(Arena* arena) {
+	while (arena->block) {
+		ArenaBlock* last = arena->block->last;
+		free(arena->block);
+		arena->block = last;
+	}
+	free(arena);
+}
+
+void* arena_alloc(Arena* arena, size_t size) {
+	size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+	ArenaBlock* block = arena->block;
+	if (block->used + size > block->size) {
+		// Out of room, so start a new block at least twice as big
+		block = arena->block = arena_block(size > block->size * 2 ? size : block->size * 2, block);
+	}
+	void* memory = &block->data[block->used];
+	block->used += size;
+	return memory;
+}
+
+void* arena_grow(Arena* arena, void* memory, size_t old_size, size_t new_size) {
+	ArenaBlock* block = arena->block;
+	old_size = (old_size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+	new_size = (new_size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+	// The last piece taken can be grown in place
+	if (memory && (char*)memory + old_size == &block->data[block->used] && block->used - old_size + new_size <= block->size) {
+		block->used = block->used - old_size + new_size;
+		return memory;
+	}
+
+	void* moved = arena_alloc(arena, new_size);
+	if (memory) memcpy(moved, memory, old_size < new_size ? old_size : new_size);
+	return moved;
+}
+
+void arena_reset(Arena* arena) {
+	// If the last frame needed more than one block, replace them with a single block that holds all of them
+	if (arena->block->last) {
+		size_t size = 0;
+		while (arena->block) {
+			ArenaBlock* last = arena->block->last;
+			size += arena->block->size;
+			free(arena->block);
+			arena->block = last;
+		}
+		arena->block = arena_block(size, NULL);
+	}
+	arena->block->used = 0;
+}
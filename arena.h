@@ -0,0 +1,24 @@
+// Frame arena, for scratch memory that is only needed for one frame
+// Memory is handed out from a block one piece after another, and all of it is given back at once by arena_reset.
+// If a frame needs more than the block holds, more blocks are added, and the next reset swaps them for one block big enough for all of them.
+// So once the frames stop getting bigger, the arena doesn't call malloc at all.
+#pragma once
+
+#include <stddef.h>
+
+typedef struct Arena Arena;
+
+// Create an arena, with a first block of size bytes
+Arena* arena_create(size_t size);
+
+void arena_free(Arena* arena);
+
+// Take size bytes from the arena, aligned for any type. The memory is uninitialized.
+void* arena_alloc(Arena* arena, size_t size);
+
+// Resize memory from the arena, like realloc, the contents up to the smaller size are kept.
+// The last piece taken is grown where it is if there is room, otherwise it's copied and the old piece is left unused until the reset.
+void* arena_grow(Arena* arena, void* memory, size_t old_size, size_t new_size);
+
+// Give back everything taken from the arena, anything taken before must not be used after this.
+void arena_reset(Arena* arena);
@@ -0,0 +1,270 @@
+// Headless renderer benchmark
+// Renders a map into an in memory canvas, with the camera following a scripted path, and reports frame times.
+// Does not need a display or SDL, so it can run anywhere.
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include "map.h"
+#include "grid.h"
+#include "render.h"
+#include "render_pool.h"
+#include "texture.h"
+#include "stats.h"
+#include "capture.h"
+
+// Frames rendered (and not timed) before the benchmark starts
+#define WARMUP_FRAMES 16
+// Frames rendered with the camera stopped after the benchmark, to check the frame loop doesn't allocate
+#define STEADY_FRAMES 16
+// Views from along the camera path drawn together as a batch, and how many times the batch is drawn, to measure views per second
+#define BATCH_VIEWS 64
+#define BATCH_ROUNDS 4
+// Frames of space in the capture ring
+#define CAPTURE_SLOTS 16
+
+// Number of calls to malloc, calloc and realloc.
+// The linker sends every call through the wrappers below (see build.sh), so allocations in the frame loop can be counted.
+unsigned long allocations = 0;
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* memory, size_t size);
+
+void* __wrap_malloc(size_t size) {
+	__atomic_add_fetch(&allocations, 1, __ATOMIC_RELAXED);
+	return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t count, size_t size) {
+	__atomic_add_fetch(&allocations, 1, __ATOMIC_RELAXED);
+	return __real_calloc(count, size);
+}
+
+void* __wrap_realloc(void* memory, size_t size) {
+	__atomic_add_fetch(&allocations, 1, __ATOMIC_RELAXED);
+	return __real_realloc(memory, size);
+}
+
+double now_ms() {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec * 1000.0 + t.tv_nsec / 1000000.0;
+}
+
+// Resident memory of the process in bytes, from /proc, or 0 where that isn't available
+size_t resident_bytes() {
+	FILE* file = fopen("/proc/self/statm", "r");
+	if (!file) return 0;
+	unsigned long pages = 0, resident = 0;
+	int found = fscanf(file, "%lu %lu", &pages, &resident);
+	fclose(file);
+	return found == 2 ? resident * sysconf(_SC_PAGESIZE) : 0;
+}
+
+int compare_doubles(const void* a, const void* b) {
+	double x = *(const double*)a, y = *(const double*)b;
+	return (x > y) - (x < y);
+}
+
+// Advance the camera one step along the scripted path.
+// The camera walks forward while slowly turning, and turns away when it hits a wall.
+// This is deterministic, so every run of the same map sees the same frames.
+void step_camera(struct Map* map, struct Camera* camera, int frame) {
+	camera->angle += (frame / 120) % 2 ? 0.02 : -0.01;
+	Point2 old_location = camera->location;
+	move_camera(map, camera, (Point2) {0, 0.05});
+	if (old_location.x == camera->location.x && old_location.y == camera->location.y)
+		camera->angle += 0.5;
+}
+
+// FNV-1a hash of an image, used to check that renderer changes don't change the output
+uint32_t image_hash(uint32_t* pixels, int length) {
+	uint32_t hash = 2166136261u;
+	for (int i = 0; i < length; i++) {
+		hash ^= pixels[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+int main(int argc, char** argv) {
+	if (argc < 2 || argc > 8) {
+		printf("Usage: %s [mapfile] [frames] [width] [height] [threads] [stats.csv] [capture.y4m or .ppm]\n", argv[0]);
+		return 1;
+	}
+
+	int frames = argc > 2 ? atoi(argv[2]) : 1000;
+	int w = argc > 3 ? atoi(argv[3]) : 640/2;
+	int h = argc > 4 ? atoi(argv[4]) : 480/2;
+	int threads = argc > 5 ? atoi(argv[5]) : 1;
+	// Counters for every frame are written here, if given, - skips it so a capture file can be given without one
+	FILE* csv = NULL;
+	if (argc > 6 && strcmp(argv[6], "-")) {
+		csv = fopen(argv[6], "w");
+		if (!csv) {
+			printf("Couldn't open %s\n", argv[6]);
+			return 1;
+		}
+		stats_csv_header(csv);
+	}
+	if (frames < 1 || w < 1 || h < 1 || threads < 1) {
+		printf("Frames, resolution and threads must be positive\n");
+		return 1;
+	}
+
+	// The grid is built lazily, but it's part of what a map costs to load, so it's timed and measured here too
+	size_t memory_before = resident_bytes();
+	double load_start = now_ms();
+	struct Map* map = load_map(argv[1]);
+	if (!map) return 1;
+	map_grid(map);
+	double load_time = now_ms() - load_start;
+	size_t map_memory = resident_bytes() - memory_before;
+	// Textures are replaced with placeholders, so the results don't depend on image files
+	load_map_textures(map, NULL);
+
+	Canvas* canvas = canvas_allocate(w, h);
+	// Every timed frame is captured to a file, if given, without counting the copy in the frame time
+	FrameCapture* capture = NULL;
+	if (argc > 7) {
+		capture = capture_open(argv[7], w, h, 30, CAPTURE_SLOTS);
+		if (!capture) {
+			printf("Couldn't open %s\n", argv[7]);
+			return 1;
+		}
+	}
+	struct Camera camera = {0};
+	place_camera(map, &camera, map->starting_location, map->starting_room);
+
+	// A single thread uses the plain renderer, so the pool overhead can be measured.
+	RenderPool* pool = threads > 1 ? render_pool_create(threads) : NULL;
+	RenderContext* context = render_context_create();
+	void render() {
+		if (pool) {
+			render_frame_threaded(pool, canvas, &camera, map);
+		} else {
+			render_frame(context, canvas, &camera, map);
+		}
+	}
+	// Counters for the last frame rendered, from every context that drew part of it
+	RenderStats frame_stats() {
+		if (!pool) return stats_sum(&context, 1);
+		RenderContext* contexts[threads];
+		for (int i = 0; i < threads; i++) contexts[i] = render_pool_context(pool, i);
+		return stats_sum(contexts, threads);
+	}
+
+	for (int i = 0; i < WARMUP_FRAMES; i++) render();
+
+	// Row by row copy of the frame, like the texture the game presents
+	uint32_t* image = malloc(sizeof(uint32_t) * w * h);
+
+	// Cameras along the path are kept for drawing as a batch of views after the benchmark
+	RenderView views[BATCH_VIEWS];
+	int view_count = 0;
+	for (int i = 0; i < BATCH_VIEWS; i++) views[i].canvas = canvas_allocate(w, h);
+
+	double* times = malloc(sizeof(double) * frames);
+	double* present_times = malloc(sizeof(double) * frames);
+	double total = 0;
+	RenderStats total_stats = {0};
+	uint32_t hash = 2166136261u;
+	unsigned long start_allocations = allocations;
+	for (int frame = 0; frame < frames; frame++) {
+		step_camera(map, &camera, frame);
+
+		double start = now_ms();
+		render();
+		times[frame] = now_ms() - start;
+		total += times[frame];
+
+		RenderStats stats = frame_stats();
+		stats_add(&total_stats, &stats);
+		if (csv) stats_csv_row(csv, frame, times[frame], &stats);
+
+		start = now_ms();
+		canvas_transpose(canvas, image, sizeof(uint32_t) * w);
+		present_times[frame] = now_ms() - start;
+
+		hash = (hash ^ image_hash(image, w * h)) * 16777619u;
+		if (capture) capture_frame(capture, canvas);
+		if (frame % ((frames + BATCH_VIEWS - 1) / BATCH_VIEWS) == 0) views[view_count++].camera = camera;
+	}
+
+	unsigned long timed_allocations = allocations - start_allocations;
+
+	// With the camera stopped every frame is the same, so once the scratch memory has settled nothing should be allocated.
+	// The first two frames are left out, the arena can still be merging blocks from the last frame that grew.
+	for (int i = 0; i < 2; i++) render();
+	start_allocations = allocations;
+	for (int i = 0; i < STEADY_FRAMES; i++) render();
+	unsigned long steady_allocations = allocations - start_allocations;
+
+	// Draw the views as batches, and check each one matches the view drawn on its own
+	void render_views() {
+		if (pool) {
+			render_pool_views(pool, views, view_count, map);
+		} else {
+			for (int i = 0; i < view_count; i++) render_frame(context, views[i].canvas, &views[i].camera, map);
+		}
+	}
+	render_views();
+	double views_start = now_ms();
+	for (int i = 0; i < BATCH_ROUNDS; i++) render_views();
+	double views_time = now_ms() - views_start;
+	int views_wrong = 0;
+	for (int i = 0; i < view_count; i++) {
+		render_frame(context, canvas, &views[i].camera, map);
+		if (image_hash(canvas->pixels, w * h) != image_hash(views[i].canvas->pixels, w * h)) views_wrong++;
+	}
+
+	qsort(times, frames, sizeof(double), compare_doubles);
+	qsort(present_times, frames, sizeof(double), compare_doubles);
+	printf("map:      %s\n", argv[1]);
+	printf("numeric:  %s\n", render_numeric());
+	printf("load:     %.4f ms\n", load_time);
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	printf("memory:   %.2f MB for the map, %.2f MB peak\n", map_memory / 1048576.0, usage.ru_maxrss / 1024.0);
+	printf("frames:   %d at %dx%d, %d threads\n", frames, w, h, threads);
+	printf("min:      %.4f ms\n", times[0]);
+	printf("median:   %.4f ms\n", times[frames / 2]);
+	printf("p99:      %.4f ms\n", times[(int)(frames * 0.99)]);
+	printf("fps:      %.1f\n", frames / (total / 1000.0));
+	printf("present:  %.4f ms median (not included above)\n", present_times[frames / 2]);
+	long pixels = 0;
+	for (int i = 0; i < RENDER_PRIMITIVES; i++) pixels += total_stats.pixels[i];
+	printf("rooms:    %.1f per frame, deepest %d\n", (double)total_stats.rooms / frames, total_stats.max_depth);
+	printf("overdraw: %.3f writes per pixel\n", (double)pixels / ((double)w * h * frames));
+	printf("allocs:   %lu while moving, %lu while stopped\n", timed_allocations, steady_allocations);
+	printf("views:    %.1f per second, %d at a time\n", view_count * BATCH_ROUNDS / (views_time / 1000.0), view_count);
+	printf("checksum: %08x\n", hash);
+	if (capture) {
+		// Closing waits for the writer, so every frame that wasn't dropped is in the file
+		CaptureStats capture_counts = capture_close(capture);
+		printf("capture:  %lu frames written, %lu dropped\n", capture_counts.written, capture_counts.dropped);
+	}
+
+	if (csv) fclose(csv);
+	free(times);
+	free(present_times);
+	free(image);
+	for (int i = 0; i < BATCH_VIEWS; i++) canvas_free(views[i].canvas);
+	if (pool) render_pool_free(pool);
+	render_context_free(context);
+	canvas_free(canvas);
+	free_map(map);
+	if (views_wrong) {
+		fprintf(stderr, "error: %d views drawn in a batch didn't match the same view drawn on its own\n", views_wrong);
+		return 1;
+	}
+	if (steady_allocations) {
+		fprintf(stderr, "error: the frame loop allocated memory with the camera stopped\n");
+		return 1;
+	}
+	return 0;
+}
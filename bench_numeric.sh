@@ -0,0 +1,7 @@
+#!/bin/sh
+# Compare the renderer built with each number type on the same camera path, see the top of render.c
+# Usage: ./bench_numeric.sh mapfile [frames] [width] [height] [threads]
+for bench in ./bench_double ./bench ./bench_fixed; do
+	$bench "$@" | grep -E "^(numeric|min|median|p99|fps|checksum):"
+	echo
+done
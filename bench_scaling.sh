@@ -0,0 +1,23 @@
+#!/bin/sh
+# See how load time, memory and frame time grow with the size of generated stress maps, see mapgen.c
+# Usage: ./bench_scaling.sh [frames] [width] [height] [threads]
+frames=${1:-200}
+width=${2:-320}
+height=${3:-240}
+threads=${4:-1}
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+run() {
+	shape=$1
+	shift
+	for size in "$@"; do
+		echo "$shape $size"
+		./mapgen $shape $size "$dir/$shape.map" || exit 1
+		./bench "$dir/$shape.map" $frames $width $height $threads | grep -E "^(load|memory|median|p99|rooms):"
+		echo
+	done
+}
+run grid 4 16 64 128 512x8
+run corridor 16 256 4096
+run room 64 1024 8192
+run hub 16 256 2048
@@ -1,2 +1,9 @@
 #!/bin/sh
-gcc map.c math.c main.c -o game -Wall -std=c99 -lSDL2 -lm -gdwarf -lSDL2_image -O3
+gcc map.c math.c grid.c texture.c light.c arena.c render.c render_pool.c redraw.c stats.c capture.c resolution.c stream.c simulation.c demo.c main.c -o game -Wall -std=c99 -pthread -lSDL2 -lm -gdwarf -lSDL2_image -O3
+gcc map.c math.c grid.c texture.c light.c arena.c render.c render_pool.c stats.c capture.c bench.c -o bench -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc -Wall -std=c99 -pthread -lm -gdwarf -O3
+gcc -DRENDER_DOUBLE map.c math.c grid.c texture.c light.c arena.c render.c render_pool.c stats.c capture.c bench.c -o bench_double -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc -Wall -std=c99 -pthread -lm -gdwarf -O3
+gcc -DRENDER_FIXED map.c math.c grid.c texture.c light.c arena.c render.c render_pool.c stats.c capture.c bench.c -o bench_fixed -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc -Wall -std=c99 -pthread -lm -gdwarf -O3
+gcc map.c math.c grid.c texture.c pvs.c mapc.c -o mapc -Wall -std=c99 -pthread -lm -gdwarf -O3
+gcc map.c math.c grid.c texture.c light.c arena.c render.c render_pool.c simulation.c demo.c replay.c -o replay -Wall -std=c99 -pthread -lm -gdwarf -O3
+gcc mapgen.c -o mapgen -Wall -std=c99 -lm -O3
+gcc map.c math.c grid.c texture.c simulation.c test_collide.c -o test_collide -Wall -std=c99 -lm -gdwarf -O3
@@ -0,0 +1,147 @@
+// Frame capture, see capture.h
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include "capture.h"
+
+enum CaptureFormat {
+	CAPTURE_Y4M,
+	CAPTURE_PPM,
+};
+
+struct FrameCapture {
+	FILE* file;
+	enum CaptureFormat format;
+	int w, h;
+	// The ring, slot_count frames of w * h pixels, stored column by column like a canvas
+	uint32_t* slots;
+	int slot_count;
+	// Frames put into the ring and taken out of it, slots are used in order so frame n is in slot n % slot_count.
+	// Only the capturing thread changes head, and only the writer changes tail.
+	unsigned long head, tail;
+	unsigned long written, dropped;
+	// Posted once for every frame put into the ring, and once more to stop the writer
+	sem_t ready;
+	int quit;
+	pthread_t thread;
+	// The frame being written, converted to the file's format
+	uint8_t* out;
+};
+
+uint32_t* capture_slot(FrameCapture* capture, unsigned long frame) {
+	return &capture->slots[(frame % capture->slot_count) * (size_t)capture->w * capture->h];
+}
+
+// Convert a frame from the ring and write it to the file
+void write_frame(FrameCapture* capture, uint32_t* pixels) {
+	int w = capture->w, h = capture->h;
+	size_t plane = (size_t)w * h;
+	uint8_t* out = capture->out;
+	for (int y = 0; y < h; y++) {
+		for (int x = 0; x < w; x++) {
+			uint32_t pixel = pixels[y + (size_t)x * h];
+			int r = pixel >> 24, g = pixel >> 16 & 0xff, b = pixel >> 8 & 0xff;
+			size_t i = x + (size_t)y * w;
+			if (capture->format == CAPTURE_Y4M) {
+				// BT.601 in studio range, the offsets are folded in before shifting so nothing negative is shifted
+				out[i] = (66 * r + 129 * g + 25 * b + 4224) >> 8;
+				out[plane + i] = (-38 * r - 74 * g + 112 * b + 32896) >> 8;
+				out[plane * 2 + i] = (112 * r - 94 * g - 18 * b + 32896) >> 8;
+			} else {
+				out[i * 3] = r;
+				out[i * 3 + 1] = g;
+				out[i * 3 + 2] = b;
+			}
+		}
+	}
+	if (capture->format == CAPTURE_Y4M) fputs("FRAME\n", capture->file);
+	else fprintf(capture->file, "P6\n%d %d\n255\n", w, h);
+	fwrite(out, 1, plane * 3, capture->file);
+}
+
+void* capture_thread(void* data) {
+	FrameCapture* capture = data;
+	while (1) {
+		sem_wait(&capture->ready);
+		unsigned long tail = capture->tail;
+		if (tail == __atomic_load_n(&capture->head, __ATOMIC_ACQUIRE)) {
+			// Every frame put in the ring is written before stopping, since each one was posted before quit was
+			if (__atomic_load_n(&capture->quit, __ATOMIC_ACQUIRE)) break;
+			continue;
+		}
+		write_frame(capture, capture_slot(capture, tail));
+		// Only give the slot back once it has been converted, the capturing thread can write over it after this
+		__atomic_store_n(&capture->tail, tail + 1, __ATOMIC_RELEASE);
+		__atomic_add_fetch(&capture->written, 1, __ATOMIC_RELAXED);
+	}
+	return NULL;
+}
+
+FrameCapture* capture_open(const char* path, int w, int h, int fps, int slots) {
+	if (w < 1 || h < 1 || slots < 1) return NULL;
+	FILE* file = fopen(path, "wb");
+	if (!file) return NULL;
+
+	FrameCapture* capture = calloc(1, sizeof(FrameCapture));
+	size_t length = strlen(path);
+	capture->format = length >= 4 && !strcmp(path + length - 4, ".y4m") ? CAPTURE_Y4M : CAPTURE_PPM;
+	capture->file = file;
+	capture->w = w;
+	capture->h = h;
+	capture->slot_count = slots;
+	capture->slots = malloc(sizeof(uint32_t) * w * h * slots);
+	capture->out = malloc((size_t)w * h * 3);
+	if (capture->format == CAPTURE_Y4M) fprintf(file, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C444\n", w, h, fps);
+
+	sem_init(&capture->ready, 0, 0);
+	pthread_create(&capture->thread, NULL, capture_thread, capture);
+	return capture;
+}
+
+int capture_frame(FrameCapture* capture, Canvas* canvas) {
+	unsigned long head = capture->head;
+	if (head - __atomic_load_n(&capture->tail, __ATOMIC_ACQUIRE) == (unsigned long)capture->slot_count) {
+		__atomic_add_fetch(&capture->dropped, 1, __ATOMIC_RELAXED);
+		return 0;
+	}
+
+	uint32_t* slot = capture_slot(capture, head);
+	int w = capture->w, h = capture->h;
+	if (canvas->w == w && canvas->h == h) {
+		memcpy(slot, canvas->pixels, sizeof(uint32_t) * w * h);
+	} else {
+		// Nearest neighbour scaling, it only has to keep the video watchable while the resolution changes
+		for (int x = 0; x < w; x++) {
+			uint32_t* column = canvas_column(canvas, x * canvas->w / w);
+			for (int y = 0; y < h; y++) slot[y + (size_t)x * h] = column[y * canvas->h / h];
+		}
+	}
+
+	__atomic_store_n(&capture->head, head + 1, __ATOMIC_RELEASE);
+	sem_post(&capture->ready);
+	return 1;
+}
+
+CaptureStats capture_stats(FrameCapture* capture) {
+	return (CaptureStats) {
+		.written = __atomic_load_n(&capture->written, __ATOMIC_RELAXED),
+		.dropped = __atomic_load_n(&capture->dropped, __ATOMIC_RELAXED),
+		.queued = capture->head - __atomic_load_n(&capture->tail, __ATOMIC_ACQUIRE),
+	};
+}
+
+CaptureStats capture_close(FrameCapture* capture) {
+	__atomic_store_n(&capture->quit, 1, __ATOMIC_RELEASE);
+	sem_post(&capture->ready);
+	pthread_join(capture->thread, NULL);
+	CaptureStats stats = capture_stats(capture);
+	sem_destroy(&capture->ready);
+	fclose(capture->file);
+	free(capture->slots);
+	free(capture->out);
+	free(capture);
+	return stats;
+}
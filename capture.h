@@ -0,0 +1,31 @@
+// Frame capture
+// Finished canvases are copied into a ring of frame slots, and a writer thread streams them to a file, so recording never waits for the disk.
+// The ring has one producer, the thread finishing frames, and one consumer, the writer, so the slots are handed over with atomics alone.
+// If the writer falls behind and the ring is full, frames are dropped and counted, rather than slowing down the frames being recorded.
+// Files ending in .y4m are written as YUV4MPEG2, 4:4:4 so colors aren't smeared, anything else as a stream of binary PPM images.
+// Both can be read by most video tools, ffmpeg reads the PPM stream with -f image2pipe.
+#pragma once
+
+#include "render.h"
+
+typedef struct FrameCapture FrameCapture;
+
+typedef struct CaptureStats {
+	// Frames written to the file, dropped since the ring was full, and waiting in the ring
+	unsigned long written, dropped, queued;
+} CaptureStats;
+
+// Open path for writing frames of w by h pixels at fps frames a second, with slots frames of space in the ring.
+// All the memory is allocated here, so capturing frames doesn't allocate. Returns NULL if the file can't be opened.
+FrameCapture* capture_open(const char* path, int w, int h, int fps, int slots);
+
+// Copy a finished canvas into the ring and return straight away, the writer thread converts and writes it.
+// Canvases of a diffrent size to the capture are scaled to it. Returns 0 if the ring was full and the frame was dropped.
+// Only one thread may capture frames at a time.
+int capture_frame(FrameCapture* capture, Canvas* canvas);
+
+CaptureStats capture_stats(FrameCapture* capture);
+
+// Write the frames left in the ring, stop the writer thread, close the file, and free the capture.
+// Returns the final counts, with every frame that wasn't dropped written.
+CaptureStats capture_close(FrameCapture* capture);
@@ -0,0 +1,135 @@
+// Demos, see demo.h
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "demo.h"
+
+// Demo file layout:
+//  - struct DemoFileHeader
+//  - run_count uint32_t runs, as in struct Demo
+// Everything is native endian, like binary maps.
+
+#define DEMO_MAGIC "3DDM"
+#define DEMO_VERSION 1
+
+struct DemoFileHeader {
+	char magic[4];
+	uint32_t version;
+	double tick_rate;
+	uint32_t map_rooms;
+	uint32_t run_count;
+	// The starting camera, its cached sin and cos are left out since they follow the angle
+	float x, y, z, angle;
+	int32_t room;
+};
+
+Demo* demo_create(struct Camera start, double tick_rate, struct Map* map) {
+	Demo* demo = calloc(1, sizeof(Demo));
+	demo->tick_rate = tick_rate;
+	demo->start = start;
+	demo->map_rooms = map->length;
+	return demo;
+}
+
+void demo_free(Demo* demo) {
+	if (!demo) return;
+	free(demo->runs);
+	free(demo);
+}
+
+void demo_record(Demo* demo, int keys, unsigned long ticks) {
+	while (ticks > 0) {
+		// Carry on the last run if the same keys are still held
+		if (demo->run_count > 0) {
+			uint32_t* last = &demo->runs[demo->run_count - 1];
+			unsigned long length = *last >> 8;
+			if ((int)(*last & 0xff) == keys && length < DEMO_MAX_RUN) {
+				unsigned long added = MIN(ticks, DEMO_MAX_RUN - length);
+				*last += added << 8;
+				ticks -= added;
+				continue;
+			}
+		}
+		if (demo->run_count == demo->run_capacity) {
+			demo->run_capacity = MAX(demo->run_capacity * 2, 64);
+			demo->runs = realloc(demo->runs, sizeof(uint32_t) * demo->run_capacity);
+		}
+		demo->runs[demo->run_count++] = keys & 0xff;
+	}
+}
+
+unsigned long demo_ticks(Demo* demo) {
+	unsigned long ticks = 0;
+	for (int i = 0; i < demo->run_count; i++) ticks += demo->runs[i] >> 8;
+	return ticks;
+}
+
+int demo_save(Demo* demo, const char* path) {
+	FILE* file = fopen(path, "wb");
+	if (!file) return -1;
+	struct DemoFileHeader header = {
+		.version = DEMO_VERSION,
+		.tick_rate = demo->tick_rate,
+		.map_rooms = demo->map_rooms,
+		.run_count = demo->run_count,
+		.x = demo->start.location.x,
+		.y = demo->start.location.y,
+		.z = demo->start.z,
+		.angle = demo->start.angle,
+		.room = demo->start.room_idx,
+	};
+	memcpy(header.magic, DEMO_MAGIC, 4);
+	int ok = fwrite(&header, sizeof(header), 1, file) == 1;
+	if (demo->run_count) ok = ok && fwrite(demo->runs, sizeof(uint32_t), demo->run_count, file) == (size_t)demo->run_count;
+	ok = !fclose(file) && ok;
+	return ok ? 0 : -1;
+}
+
+Demo* demo_load(const char* path) {
+	FILE* file = fopen(path, "rb");
+	if (!file) {
+		printf("Couldn't open %s\n", path);
+		return NULL;
+	}
+	struct DemoFileHeader header;
+	const char* error = NULL;
+	// The runs are checked against the size of the file before anything is allocated for them, so a broken header can't ask for gigabytes
+	long size = -1;
+	if (!fseek(file, 0, SEEK_END)) size = ftell(file);
+	if (size < 0 || fseek(file, 0, SEEK_SET)) error = "can't find its size";
+	else if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, DEMO_MAGIC, 4)) error = "not a demo";
+	else if (header.version != DEMO_VERSION) error = "unsupported version";
+	else if (!(header.tick_rate > 0)) error = "bad tick rate";
+	else if (header.run_count > INT_MAX) error = "too many runs";
+	else if (header.run_count > (unsigned long)(size - sizeof(header)) / sizeof(uint32_t)) error = "file is cut short";
+	if (error) {
+		printf("Failed to load demo %s: %s\n", path, error);
+		fclose(file);
+		return NULL;
+	}
+
+	uint32_t* runs = malloc(sizeof(uint32_t) * (header.run_count ? header.run_count : 1));
+	if (!runs) {
+		printf("Failed to load demo %s: out of memory\n", path);
+		fclose(file);
+		return NULL;
+	}
+	Demo* demo = calloc(1, sizeof(Demo));
+	demo->tick_rate = header.tick_rate;
+	demo->map_rooms = header.map_rooms;
+	demo->start.location.x = header.x;
+	demo->start.location.y = header.y;
+	demo->start.z = header.z;
+	demo->start.angle = header.angle;
+	demo->start.room_idx = header.room;
+	demo->run_count = demo->run_capacity = header.run_count;
+	demo->runs = runs;
+	if (fread(demo->runs, sizeof(uint32_t), header.run_count, file) != header.run_count) {
+		printf("Failed to load demo %s: file is cut short\n", path);
+		demo_free(demo);
+		demo = NULL;
+	}
+	fclose(file);
+	return demo;
+}
@@ -0,0 +1,39 @@
+// Demos
+// A demo is the camera at the start of a recording, and the keys held down on every tick of the simulation after it.
+// The simulation only depends on the map and the keys, not on frame timing, so playing the keys back tick by tick moves the camera exactly the same way.
+// Keys change rarely compared to the tick rate, so they are stored as runs of ticks with the same keys held.
+// Maps that are streamed in have no walls in rooms that aren't loaded, so a demo recorded while streaming may only play back the same with the whole map loaded if the camera never got ahead of the loading.
+#pragma once
+
+#include <stdint.h>
+#include "simulation.h"
+
+// The most ticks in a run, longer runs are split up
+#define DEMO_MAX_RUN 0xffffff
+
+typedef struct Demo {
+	double tick_rate;
+	struct Camera start;
+	// Rooms in the map it was recorded on, to catch playing it back on the wrong map
+	int map_rooms;
+	// Runs of ticks with the same keys held, each is the number of ticks << 8 | the PlayerKey bits
+	uint32_t* runs;
+	int run_count, run_capacity;
+} Demo;
+
+// Start recording, from a camera on a map simulated at tick_rate ticks a second.
+Demo* demo_create(struct Camera start, double tick_rate, struct Map* map);
+
+void demo_free(Demo* demo);
+
+// Add ticks ticks with keys held down.
+void demo_record(Demo* demo, int keys, unsigned long ticks);
+
+// Total number of ticks recorded.
+unsigned long demo_ticks(Demo* demo);
+
+// Write the demo to a file, returns 0 on success.
+int demo_save(Demo* demo, const char* path);
+
+// Read a demo written by demo_save, returns NULL and prints why if it can't be read.
+Demo* demo_load(const char* path);
@@ -0,0 +1,257 @@
+// Spatial index for maps, see grid.h
+#include <stdlib.h>
+#include <math.h>
+#include "grid.h"
+
+// Find the range of cells covering a box, clamped to the grid.
+// Returns 0 if the box is entirely outside the grid.
+int grid_cells(struct MapGrid* grid, Point2 low, Point2 high, int* x0, int* y0, int* x1, int* y1) {
+	float fx0 = floorf((low.x - grid->origin.x) / grid->cell_size);
+	float fy0 = floorf((low.y - grid->origin.y) / grid->cell_size);
+	float fx1 = floorf((high.x - grid->origin.x) / grid->cell_size);
+	float fy1 = floorf((high.y - grid->origin.y) / grid->cell_size);
+	if (!(fx1 >= 0 && fy1 >= 0 && fx0 < grid->w && fy0 < grid->h)) return 0;
+	*x0 = MAX(fx0, 0);
+	*y0 = MAX(fy0, 0);
+	*x1 = MIN(fx1, grid->w - 1);
+	*y1 = MIN(fy1, grid->h - 1);
+	return 1;
+}
+
+// Bounding box of a room
+void room_bounds(struct Room* room, Point2* low, Point2* high) {
+	*low = *high = room->walls[0].location;
+	for (int i = 1; i < room->length; i++) {
+		Point2 p = room->walls[i].location;
+		low->x = MIN(low->x, p.x);
+		low->y = MIN(low->y, p.y);
+		high->x = MAX(high->x, p.x);
+		high->y = MAX(high->y, p.y);
+	}
+}
+
+// Add an entry for a wall or room to the front of a cell's list
+void grid_add(struct MapGrid* grid, int item, int cell) {
+	int entry = grid->free_entry;
+	if (entry != -1) {
+		grid->free_entry = grid->entries[entry].next;
+	} else {
+		if (grid->entry_count == grid->entry_capacity) {
+			grid->entry_capacity = MAX(grid->entry_capacity * 2, 64);
+			grid->entries = realloc(grid->entries, sizeof(struct GridEntry) * grid->entry_capacity);
+		}
+		entry = grid->entry_count++;
+	}
+	grid->entries[entry] = (struct GridEntry) {item, grid->cell_first[cell]};
+	grid->cell_first[cell] = entry;
+}
+
+// Add every wall of a room, and its bounds, to the cells they overlap.
+// If count isn't NULL, the entries are only counted, and added to it.
+void grid_add_room(struct MapGrid* grid, struct Map* map, int roomid, size_t* count) {
+	struct Room* room = map->rooms[roomid];
+	if (!count) grid->room_cells[roomid] = (struct GridCells) {0, 0, -1, -1};
+	if (room->length == 0) return;
+	int start = map->walls.slot_start[roomid];
+	for (int wall = -1; wall < room->length; wall++) {
+		Point2 low, high;
+		if (wall == -1) {
+			room_bounds(room, &low, &high);
+		} else {
+			Point2 p0 = room->walls[wall].location;
+			Point2 p1 = room->walls[wall + 1 < room->length ? wall + 1 : 0].location;
+			low = (Point2) {MIN(p0.x, p1.x), MIN(p0.y, p1.y)};
+			high = (Point2) {MAX(p0.x, p1.x), MAX(p0.y, p1.y)};
+		}
+
+		int x0, y0, x1, y1;
+		if (!grid_cells(grid, low, high, &x0, &y0, &x1, &y1)) continue;
+		if (count) {
+			*count += (size_t)(x1 - x0 + 1) * (y1 - y0 + 1);
+			continue;
+		}
+		// Every wall is inside the room's bounds, so those are all the cells it is put in
+		if (wall == -1) grid->room_cells[roomid] = (struct GridCells) {x0, y0, x1, y1};
+		for (int y = y0; y <= y1; y++)
+			for (int x = x0; x <= x1; x++)
+				grid_add(grid, wall == -1 ? -1 - roomid : start + wall, x + y * grid->w);
+	}
+}
+
+// Take every entry for a room out of the grid, its walls are the ones in its slot
+void grid_remove_room(struct MapGrid* grid, struct Map* map, int roomid) {
+	struct GridCells cells = grid->room_cells[roomid];
+	int start = map->walls.slot_start[roomid], end = map->walls.slot_start[roomid + 1];
+	for (int y = cells.y0; y <= cells.y1; y++) {
+		for (int x = cells.x0; x <= cells.x1; x++) {
+			int* link = &grid->cell_first[x + y * grid->w];
+			while (*link != -1) {
+				int entry = *link;
+				int item = grid->entries[entry].item;
+				if (item == -1 - roomid || (item >= start && item < end)) {
+					*link = grid->entries[entry].next;
+					grid->entries[entry].next = grid->free_entry;
+					grid->free_entry = entry;
+				} else {
+					link = &grid->entries[entry].next;
+				}
+			}
+		}
+	}
+	grid->room_cells[roomid] = (struct GridCells) {0, 0, -1, -1};
+}
+
+struct MapGrid* build_map_grid(struct Map* map) {
+	struct MapGrid* grid = calloc(1, sizeof(struct MapGrid));
+
+	// Find the bounds of the map, starting from the box known to hold every room if there is one.
+	// Walls are counted by their slots, which include the walls of rooms that aren't loaded.
+	int walls = map->walls.slot_start[map->length];
+	Point2 low = map->bounds_low, high = map->bounds_high;
+	for (int i = 0; i < map->length; i++) {
+		struct Room* room = map->rooms[i];
+		if (room->length == 0) continue;
+		Point2 room_low, room_high;
+		room_bounds(room, &room_low, &room_high);
+		low = (Point2) {MIN(low.x, room_low.x), MIN(low.y, room_low.y)};
+		high = (Point2) {MAX(high.x, room_high.x), MAX(high.y, room_high.y)};
+	}
+	if (!(low.x <= high.x && low.y <= high.y)) low = high = (Point2) {0, 0};
+
+	// Aim for about one cell per wall
+	float width = MAX(high.x - low.x, 0.001);
+	float height = MAX(high.y - low.y, 0.001);
+	grid->cell_size = sqrtf(width * height / MAX(walls, 1));
+	grid->cell_size = MAX(grid->cell_size, MAX(width, height) / 4096);
+	grid->origin = low;
+	grid->w = width / grid->cell_size + 1;
+	grid->h = height / grid->cell_size + 1;
+
+	grid->cell_first = malloc(sizeof(int) * grid->w * grid->h);
+	grid->room_cells = malloc(sizeof(struct GridCells) * (map->length ? map->length : 1));
+	for (int i = 0; i < grid->w * grid->h; i++) grid->cell_first[i] = -1;
+	grid->free_entry = -1;
+	// Count the entries first, so there is exactly enough room for them
+	size_t entries = 0;
+	for (int i = 0; i < map->length; i++) grid_add_room(grid, map, i, &entries);
+	grid->entry_capacity = MAX(entries, 1);
+	grid->entries = malloc(sizeof(struct GridEntry) * grid->entry_capacity);
+	// Entries go on the front of each cell, so adding the rooms backwards leaves each cell in order
+	for (int i = map->length - 1; i >= 0; i--) grid_add_room(grid, map, i, NULL);
+	return grid;
+}
+
+void free_map_grid(struct MapGrid* grid) {
+	if (!grid) return;
+	free(grid->entries);
+	free(grid->cell_first);
+	free(grid->room_cells);
+	free(grid);
+}
+
+void map_grid_update_room(struct Map* map, int roomid) {
+	struct MapGrid* grid = map->grid;
+	if (!grid) return;
+	grid_remove_room(grid, map, roomid);
+
+	// Rooms outside the grid would be squashed into the cells on its edges, so make a bigger one
+	struct Room* room = map->rooms[roomid];
+	if (room->length == 0) return;
+	Point2 low, high;
+	room_bounds(room, &low, &high);
+	if (
+		low.x < grid->origin.x || low.y < grid->origin.y ||
+		high.x >= grid->origin.x + grid->w * grid->cell_size || high.y >= grid->origin.y + grid->h * grid->cell_size
+	) {
+		free_map_grid(grid);
+		map->grid = NULL;
+		return;
+	}
+	grid_add_room(grid, map, roomid, NULL);
+}
+
+struct MapGrid* map_grid(struct Map* map) {
+	if (!map->grid) map->grid = build_map_grid(map);
+	return map->grid;
+}
+
+// map_collide, but portals into room skip are passed over, -1 skips none
+int collide_skipping(struct Map* map, int roomid, Point2 p0, Point2 p1, int skip, Point2* point_of_collision) {
+	struct MapGrid* grid = map_grid(map);
+	struct Room* room = map->rooms[roomid];
+	Point2 low = {MIN(p0.x, p1.x), MIN(p0.y, p1.y)};
+	Point2 high = {MAX(p0.x, p1.x), MAX(p0.y, p1.y)};
+
+	// Like room_collide, return the first wall in the room that is hit
+	int hit = -1;
+	Point2 hit_point;
+	int x0, y0, x1, y1;
+	if (!grid_cells(grid, low, high, &x0, &y0, &x1, &y1)) return -1;
+	int start = map->walls.slot_start[roomid];
+	for (int y = y0; y <= y1; y++) {
+		for (int x = x0; x <= x1; x++) {
+			for (int i = grid->cell_first[x + y * grid->w]; i != -1; i = grid->entries[i].next) {
+				// Only walls in the room, by their slots
+				int wall = grid->entries[i].item - start;
+				if (grid->entries[i].item < 0 || wall < 0 || wall >= room->length) continue;
+				if (hit != -1 && wall >= hit) continue;
+				if (skip != -1 && room->walls[wall].portal_idx == skip) continue;
+
+				Point2 w0 = room->walls[wall].location;
+				Point2 w1 = room->walls[wall + 1 < room->length ? wall + 1 : 0].location;
+				Point2 intersection = intersect_line_segments(p0, p1, w0, w1);
+				if (!isnan(intersection.x)) {
+					hit = wall;
+					hit_point = intersection;
+				}
+			}
+		}
+	}
+	if (hit != -1 && point_of_collision) *point_of_collision = hit_point;
+	return hit;
+}
+
+int map_collide(struct Map* map, int roomid, Point2 p0, Point2 p1, Point2* point_of_collision) {
+	return collide_skipping(map, roomid, p0, p1, -1, point_of_collision);
+}
+
+int map_trace(struct Map* map, int roomid, Point2 p0, Point2 p1) {
+	// Rooms are convex, so the segment leaves each one at most once, by the wall it hits.
+	// The rest of it starts on the portal it came in through, which would be hit again straight away, so that one is skipped.
+	int from = -1;
+	for (int steps = 0; steps < map->length; steps++) {
+		int wall = collide_skipping(map, roomid, p0, p1, from, &p0);
+		if (wall == -1) break;
+		int portal = map->rooms[roomid]->walls[wall].portal_idx;
+		if (portal == -1 || map->rooms[portal] == &map_missing_room) break;
+		from = roomid;
+		roomid = portal;
+	}
+	return roomid;
+}
+
+// Check if a point is inside a room, by counting how many walls a ray going +x from the point crosses.
+int room_contains(struct Room* room, Point2 point) {
+	int inside = 0;
+	for (int i = 0; i < room->length; i++) {
+		Point2 a = room->walls[i].location;
+		Point2 b = room->walls[i + 1 < room->length ? i + 1 : 0].location;
+		if ((a.y > point.y) != (b.y > point.y)) {
+			float crossing = a.x + (point.y - a.y) / (b.y - a.y) * (b.x - a.x);
+			if (point.x < crossing) inside = !inside;
+		}
+	}
+	return inside;
+}
+
+int map_locate(struct Map* map, Point2 point) {
+	struct MapGrid* grid = map_grid(map);
+	int x, y;
+	if (!grid_cells(grid, point, point, &x, &y, &x, &y)) return -1;
+
+	for (int i = grid->cell_first[x + y * grid->w]; i != -1; i = grid->entries[i].next) {
+		int roomid = -1 - grid->entries[i].item;
+		if (roomid >= 0 && room_contains(map->rooms[roomid], point)) return roomid;
+	}
+	return -1;
+}
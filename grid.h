@@ -0,0 +1,59 @@
+// Spatial index for maps
+// A uniform grid over the map, where every cell lists the walls and rooms that overlap it.
+// This makes collision and finding the room a point is in cost about the same no matter how big the rooms or map are.
+#pragma once
+
+#include "map.h"
+
+// An entry in a cell of the grid, for a wall or a room
+struct GridEntry {
+	// The wall's slot in the map's packed walls, or -1 - the room for a room's bounds
+	int item;
+	// The next entry in the same cell, or -1. Unused entries are kept in a list through this too.
+	int next;
+};
+
+// The cells a room was put in, from x0, y0 to x1, y1 inclusive, x1 is -1 if it wasn't put in any
+struct GridCells {
+	int x0, y0, x1, y1;
+};
+
+struct MapGrid {
+	// Corner of the grid with the lowest x and y
+	Point2 origin;
+	float cell_size;
+	int w, h;
+	// Every cell has a list of the walls, and rooms by their bounds, overlapping it, starting at cell_first, or -1 if it is empty.
+	struct GridEntry* entries;
+	int entry_count, entry_capacity;
+	int free_entry;
+	int* cell_first;
+	// When a room changes it is taken out of the cells it was in and put back in, without touching the rest of the grid
+	struct GridCells* room_cells;
+};
+
+// Build a grid for a map, its walls have to be packed, see map_changed
+struct MapGrid* build_map_grid(struct Map* map);
+
+void free_map_grid(struct MapGrid* grid);
+
+// Put a room in the map's grid again after it changed, called by map_room_changed and map_room_replaced.
+// If the room is outside the grid, the grid is thrown away to be built again when it is next needed.
+void map_grid_update_room(struct Map* map, int roomid);
+
+// Get the grid for a map, building it the first time.
+// This is not thread safe the first time it is called for a map.
+struct MapGrid* map_grid(struct Map* map);
+
+// Same as room_collide, for room roomid of the map, but only tests the walls near the line segment.
+int map_collide(struct Map* map, int roomid, Point2 p0, Point2 p1, Point2* point_of_collision);
+
+// Find the room the end of a line segment from p0, in room roomid, to p1 is in, following it through as many portals as it crosses.
+// It stops in the last room it got to at a wall, or a portal to a room that isn't streamed in, like move_camera would.
+int map_trace(struct Map* map, int roomid, Point2 p0, Point2 p1);
+
+// Check if a point is inside a room.
+int room_contains(struct Room* room, Point2 point);
+
+// Find the room a point is in, returns -1 if it isn't in any room.
+int map_locate(struct Map* map, Point2 point);
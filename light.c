@@ -0,0 +1,23 @@
+// Lighting, see light.h
+#include "light.h"
+#include "math.h"
+
+Colormap colormaps[LIGHT_LEVELS];
+int colormaps_ready = 0;
+
+void light_init() {
+	if (colormaps_ready) return;
+	for (int level = 0; level < LIGHT_LEVELS; level++)
+		for (int value = 0; value < 256; value++)
+			colormaps[level][value] = (value * level + (LIGHT_LEVELS - 1) / 2) / (LIGHT_LEVELS - 1);
+	colormaps_ready = 1;
+}
+
+int light_level(int light, float inverse_depth) {
+	// Written so a depth of zero or NaN is fully bright instead of undefined
+	float falloff = LIGHT_FALLOFF * inverse_depth;
+	if (!(falloff < 1)) falloff = 1;
+	float brightness = light / 255.0f * falloff;
+	int level = brightness * (LIGHT_LEVELS - 1) + 0.5f;
+	return MIN(MAX(level, 0), LIGHT_LEVELS - 1);
+}
@@ -0,0 +1,27 @@
+// Lighting
+// Like Doom, light goes through colormaps, a table for each light level giving what a color value looks like at that light.
+// Pixels are RGBA8888 rather than palette indexes, so a table maps one 8 bit channel, and shading a pixel is a lookup for each color channel.
+// The level only changes with depth, so it is found once for each column of a wall or sprite and each row of a floor or ceiling.
+#pragma once
+
+#include <stdint.h>
+
+#define LIGHT_LEVELS 32
+// How far away things in a fully lit room start to get darker, after that brightness falls off with one over the distance
+#define LIGHT_FALLOFF 4.0f
+
+typedef uint8_t Colormap[256];
+
+extern Colormap colormaps[LIGHT_LEVELS];
+
+// Fill in the colormaps, only the first call does anything.
+// This must be called before any drawing, render_context_create does it.
+void light_init();
+
+// Light level of something in a room with a light of 0 to 255, at the depth with the given inverse.
+int light_level(int light, float inverse_depth);
+
+// Shade a pixel with a colormap, alpha is kept as is
+static inline uint32_t light_pixel(const uint8_t* colormap, uint32_t pixel) {
+	return (uint32_t)colormap[pixel >> 24] << 24 | (uint32_t)colormap[pixel >> 16 & 0xff] << 16 | (uint32_t)colormap[pixel >> 8 & 0xff] << 8 | (pixel & 0xff);
+}
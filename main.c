@@ -1,37 +1,63 @@
 #include "map.h"
+#include "render.h"
+#include "render_pool.h"
+#include "redraw.h"
+#include "texture.h"
+#include "stats.h"
+#include "resolution.h"
+#include "stream.h"
+#include "simulation.h"
+#include "capture.h"
+#include "demo.h"
 #include <assert.h>
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_image.h>
 
-#define float double
-
-//SDL_Surface* textures[2];
-
-// How far from the center of the viewing plain (1 unit away from camera) should the screen be?
-#define FOV .4
-
-// Flag for slow rendering
+// Flag for slow rendering, and set when it should be switched, which waits until the pool isn't drawing a frame
 int slow_render = 0;
-
-
-/////////////////////////
-// Graphics Primitives //
-/////////////////////////
-
-// A wrapper for a window, and a pixel buffer for rendering
-// Drawing should be done to the canvas surface.
+int slow_render_toggled = 0;
+
+// Set when the window needs to be shown again, even if the frame didn't change
+int window_exposed = 0;
+
+// Flags for the renderer stats overlay, and the overdraw heatmap
+int show_stats = 0;
+int overdraw = 0;
+// Set when one of the flags above changes, so the whole frame is drawn again
+int view_changed = 0;
+// File the stats of every frame are written to while recording, NULL if not recording
+FILE* stats_csv = NULL;
+// Frames are recorded to capture.y4m while this is set, see capture.h
+FrameCapture* capture = NULL;
+// Set when capturing should start or stop, this is done in the main loop since it needs the window size
+int capture_toggled = 0;
+// Ticks are recorded into this while it is set, and saved to demo.dem when recording stops, see demo.h
+Demo* demo = NULL;
+int demo_toggled = 0;
+
+
+////////////
+// Window //
+////////////
+
+// A wrapper for a window, and pixel buffers for rendering
+// There are two canvases, so the next frame can be drawn into one while the last one is shown from the other.
+// The canvases and texture are made big enough for the whole window, and smaller resolutions only use part of them, so the resolution can change every frame without allocating.
 typedef struct Window {
 	SDL_Window* window;
 	SDL_Renderer* renderer;
-	SDL_Surface* canvas;
+	Canvas* canvases[2];
+	// The texture is the canvas turned on its side, one row for every column, so canvases can be copied in without transposing.
 	SDL_Texture* canvas_texture;
+	// The biggest resolution the canvases and texture can hold
 	int w, h;
+	// Size of the frame in the texture, from the last canvas copied into it, or 0 if nothing has been since it was made
+	int shown_w, shown_h;
 } Window;
 
 // Open a window an create a Window stuct
 Window window_open() {
-//	int windowFlags = SDL_WINDOW_RESIZABLE;
-	int windowFlags = 0;
+	int windowFlags = SDL_WINDOW_RESIZABLE;
 	if (SDL_Init(SDL_INIT_VIDEO) < 0) {
 		printf("Couldn't initialize SDL: %s\n", SDL_GetError());
 		exit(1);
@@ -45,6 +71,8 @@ Window window_open() {
 	}
 	
 	SDL_Renderer* renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_PRESENTVSYNC); 
+	// The dummy and offscreen video drivers might not have vsync, so take any renderer they have
+	if (!renderer) renderer = SDL_CreateRenderer(window, -1, 0);
 	
 	if (!renderer) {
 		printf("Failed to open renderer: %s\n", SDL_GetError());
@@ -53,313 +81,99 @@ Window window_open() {
 
 	return (Window) {
 		.window = window,
-		.w = 640,
-		.h = 480,
+		.w = 0,
+		.h = 0,
+		.shown_w = 0,
+		.shown_h = 0,
 		.renderer = renderer,
-		.canvas = NULL,
+		.canvases = {NULL, NULL},
 		.canvas_texture = NULL,
 	};
 }
 
-// (re)prepare a buffer for rendering, does nothing if it is already initalized at the same resolution
-void renderer_setup(Window* window, int w, int h) {
-	// Do nothing if the current resolution is the same, and the struct is initalized.
-	if (w == window->w && h == window->h && window->canvas && window->canvas_texture) return;
+// (re)prepare the buffers for rendering at up to w by h, does nothing if they are already big enough
+// Returns 1 if new buffers were made.
+int renderer_setup(Window* window, int w, int h) {
+	// Do nothing if the buffers are big enough, and the struct is initalized.
+	if (w <= window->w && h <= window->h && window->canvases[0] && window->canvas_texture) return 0;
 
+	// Never shrink, so shrinking and growing the window back doesn't allocate every time
+	w = MAX(w, window->w);
+	h = MAX(h, window->h);
 	window->w = w;
 	window->h = h;
 
-	if (window->canvas) SDL_FreeSurface(window->canvas);
+	for (int i = 0; i < 2; i++) {
+		if (window->canvases[i]) canvas_free(window->canvases[i]);
+		window->canvases[i] = canvas_allocate(w, h);
+		assert(window->canvases[i]);
+	}
 	if (window->canvas_texture) SDL_DestroyTexture(window->canvas_texture);
-	
-	window->canvas = SDL_CreateRGBSurface(0, h, w, 32, 0xff000000, 0x00ff0000, 0x0000ff00, 0x000000ff);
-	assert(window->canvas);
 	window->canvas_texture = SDL_CreateTexture(window->renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, h, w);
 	assert(window->canvas_texture);
+	// A new texture has nothing in it yet
+	window->shown_w = 0;
+	window->shown_h = 0;
+	return 1;
 }
 
-// Show the graphics draw in the pixel buffer to the screen
-void window_present(Window window) {
-	// Copy rendered graphics to the to the gpu
-	void* texture_pixels;
-	int texture_pitch;
-	SDL_LockTexture(window.canvas_texture, NULL, &texture_pixels, &texture_pitch);
-	memcpy(texture_pixels, window.canvas->pixels, window.canvas->pitch * window.canvas->h);
-	SDL_UnlockTexture(window.canvas_texture);
-
-	// Draw the texture onto the renderer 
-	SDL_RenderCopy(window.renderer, window.canvas_texture, NULL, NULL);
-	
-	// Present the renderer
-	SDL_RenderPresent(window.renderer);
-}
-
-void vline(SDL_Surface* canvas, int x, int y0, int y1, int r, int g, int b) {
-	for (int y = y0; y < y1; y++)
-		((uint32_t*)canvas->pixels)[x + y * canvas->w] = r << 24 | g << 16 | b << 8 | 0xff;
-}
-
-// Draw a textured line
-// x, y0, and y1 are the phisical area of the line
-// texture_x, texture_y0, texture_y1 are the texture cordinates for the start and end
-// y0_orig and y1_orig are the on screen y locations of texture_y0 and texture_y1, this makes applying bounds easyer,
-// Just clip y0 and y1 but not y0_orig or y1_orig to clip the line while preserving texture layout
-void textured_vline(
-	SDL_Surface* canvas, 
-	int x, int y0, int y1,
-	int y0_orig, int y1_orig, float texture_x, float texture_y0, float texture_y1, 
-	SDL_Surface* texture
-) {
-	int texture_pixel_x = abs(texture_x * texture -> w)%texture->w;
-	int texture_pixel_y0 = texture_y0 * texture -> h;
-	int texture_pixel_y1 = texture_y1 * texture -> h;
-	for (int y = y0; y < y1; y++) {
-		int i = y0_orig - y;
-		float distance = (float)i / (float)(y1_orig - y0_orig);
-		int texture_pixel_y = lerp(texture_pixel_y0, texture_pixel_y1, distance);
-		texture_pixel_y %= texture->h;
-		texture_pixel_y = abs(texture_pixel_y);
-		uint32_t* canvas_pixel = &((uint32_t*)canvas->pixels)[x + y * canvas->w];
-		uint32_t* texture_pixel = &((uint32_t*)texture->pixels)[texture_pixel_x + texture_pixel_y * texture->w];
-		*canvas_pixel = *texture_pixel;
+// Show the graphics drawn in a canvas to the screen
+// Only the columns from x_min to x_max are copied to the gpu, the rest of the texture is left from earlier frames.
+// With no columns, the last frame in the texture is shown again, and canvas isn't used, so it can be NULL.
+void window_present(Window* window, Canvas* canvas, int x_min, int x_max) {
+	// Copy rendered graphics to the to the gpu, each column is a row of the texture so it is copied as is.
+	if (x_min < x_max) {
+		SDL_Rect area = {0, x_min, canvas->h, x_max - x_min};
+		void* texture_pixels;
+		int texture_pitch;
+		SDL_LockTexture(window->canvas_texture, &area, &texture_pixels, &texture_pitch);
+		if (texture_pitch == sizeof(uint32_t) * canvas->h) {
+			memcpy(texture_pixels, canvas_column(canvas, x_min), sizeof(uint32_t) * canvas->h * (x_max - x_min));
+		} else {
+			for (int x = x_min; x < x_max; x++)
+				memcpy((char*)texture_pixels + (x - x_min) * texture_pitch, canvas_column(canvas, x), sizeof(uint32_t) * canvas->h);
+		}
+		SDL_UnlockTexture(window->canvas_texture);
+		window->shown_w = canvas->w;
+		window->shown_h = canvas->h;
 	}
-}
-
-
 
-//////////////////////////////////////////////////
-// Cordinate space convertion                   //
-// This handles projection and camera positions //
-//////////////////////////////////////////////////
-
-// Convert a point from world space to camera based cordinates
-// In this system, the camera is at 0,0 and facing the +y direction.
-Point2 world_to_camera_space(struct Camera* camera, Point2 world) {
-	Point2 translated = {.x = world.x - camera->location.x, .y = world.y - camera->location.y };
-
-	return (Point2) {
-		.x = translated.x * camera->angle_cos - translated.y * camera->angle_sin,
-		.y = translated.x * camera->angle_sin + translated.y * camera->angle_cos
-	};
-}
-
-// Convert a camera space point to a world space poimt
-Point2 camera_to_world_space(struct Camera* camera, Point2 c) {
-	Point2 rotated =  {
-		.x = c.x * cos(-camera->angle) - c.y * sin(-camera->angle),
-		.y = c.x * sin(-camera->angle) + c.y * cos(-camera->angle)
-	};
+	// Draw the texture onto the renderer, turned a quarter turn and flipped to swap the rows and columns back.
+	// It's turned around the middle of area, so area is the size of the screen on its side, centered on the screen.
+	int screen_w, screen_h;
+	SDL_GetRendererOutputSize(window->renderer, &screen_w, &screen_h);
+	SDL_Rect area = {(screen_w - screen_h) / 2, (screen_h - screen_w) / 2, screen_h, screen_w};
+	// Only the corner of the texture the canvas was copied to is drawn, it is stretched to fill the screen.
+	// A texture that hasn't had a frame copied in yet has nothing worth showing, so the screen is just cleared.
+	if (window->shown_w > 0) {
+		SDL_Rect used = {0, 0, window->shown_h, window->shown_w};
+		SDL_RenderCopyEx(window->renderer, window->canvas_texture, &used, &area, 90, NULL, SDL_FLIP_VERTICAL);
+	} else {
+		SDL_RenderClear(window->renderer);
+	}
 	
-	return (Point2) {.x = rotated.x + camera->location.x, .y = rotated.y + camera->location.y };
-}
-
-// Convert a Point in camera space to normalized screen space.
-Point2 camera_to_screen_space(Point2 cameraspace, float z, float fov) {
-	return (Point2) {
-		.x = cameraspace.x / cameraspace.y / fov,
-		.y = z / cameraspace.y / fov,
-	};
-}
-
-// Scale and translate the screen cordinates to pixel cordinates for SDL.
-Point2 normalized_screen_to_pixel(Point2 world, float screenh, float screenw) {
-	return (Point2) {
-		.x = (world.x + 1) * (screenw / 2),
-		.y = ((-world.y) + 1) * (screenh / 2),
-	};
-}
-
-// All in one function to go from camera space to pixels
-Point2 camera_to_pixel_space(Point2 camera, float z, float screenh, float screenw, float fov) {
-	return normalized_screen_to_pixel(camera_to_screen_space(camera,z,fov), screenh, screenw);
+	// Present the renderer
+	SDL_RenderPresent(window->renderer);
 }
 
-Point2 get_texture_cordinates(Point2 point, float z) {
-	return (Point2) {
-		.x = point.x + point.y,
-		.y = z + 0.25
-	};
-} 
-
 /////////////
-// Cliping //
+// UI code //
 /////////////
 
-// This computes how much of a wall is visable, storing the start and end in w1 and w0
-// Returns false if the wall is fully outside, true otherwize
-// The does not currently check against 
-int clip_to_frustum(Point2* w0, Point2* w1, float fov) {
-	float near_plane = 0.00001;
+// Window used by slow_render_hook
+Window* debug_window = NULL;
 
-	// Clip to the near plane
-	
-	// If both are behind the near plane, reject the wall
-	if (w0 -> y < near_plane && w1 -> y < near_plane) return 0;
-
-	// If only one is, move it 
-	if (w0->y < near_plane) {
-		*w0 = intersect_lines((Point2) {1, near_plane}, (Point2) {-1, near_plane}, *w0, *w1);
+// Show every column as it is drawn if slow_render is set.
+// It's only set on the context slow rendering draws with on this thread, SDL calls and a half drawn canvas can't come from the pool's workers.
+void slow_render_hook(Canvas* canvas) {
+	if (slow_render) {
+		window_present(debug_window, canvas, 0, canvas->w);
+		SDL_Delay(10);
 	}
-	if (w1->y < near_plane) {
-		*w1 = intersect_lines((Point2) {1, near_plane}, (Point2) {-1, near_plane}, *w0, *w1);
-	}
-
-	// Clip by angle
-	float angle0 = w0->x / w0->y;
-	float angle1 = w1->x / w1->y;
-	
-	// If both endpoints are out of view, on the same side, reject the wall
-	if (angle0 > fov && angle1 > fov) return 0;
-	if (angle0 < -fov && angle1 < -fov) return 0;
-	
-	// Otherwize, move the points inside of the view.
-	if (angle1 > fov) *w1 = intersect_lines((Point2) {0, 0}, (Point2) {fov, 1}, *w0, *w1);
-	if (angle1 < -fov) *w1 = intersect_lines((Point2) {0, 0}, (Point2) {-fov, 1}, *w0, *w1);
-	
-	if (angle0 > fov) *w0 = intersect_lines((Point2) {0, 0}, (Point2) {fov, 1}, *w0, *w1);
-	if (angle0 < -fov) *w0 = intersect_lines((Point2) {0, 0}, (Point2) {-fov, 1}, *w0, *w1);
-
-	return 1;
 }
 
-//////////////
-// Renderer //
-////////////// 
-
-// The main rendering function, renders a room (roomid) from the the point of view of the camera, to canvas.
-// It will recurse to draw portals, so any connecting geometry visable trough the room is also drawn.
-// All drawing is within the x bounds given by the x_min and x_max and the y bounds in x_min and y_max.
-// h and w are the screen dimentions.
-void render_room(Window* window, struct Camera* camera, int roomid, struct Map* map, int x_min, int x_max, int y_min[], int y_max[]) {
-	int h = window->h;
-	int w = window->w;
-	SDL_Surface* canvas = window->canvas;
-	// Recaculate the sin and cos of the camera angle
-	camera->angle_cos = cos(camera->angle);
-	camera->angle_sin = sin(camera->angle);
-	
-	struct Room* room = map->rooms[roomid];
-
-	// Draw every wall in a room
-	for (int wallid = 0; wallid < room->length; wallid++) {
-		// Find the endpoints of the wall
-		struct WallVertex* w0 = &room->walls[wallid];
-		struct WallVertex* w1;
-		if (wallid+1 < room->length) {
-			w1 = &room->walls[wallid + 1];
-		} else {
-			w1 = &room->walls[0];
-		}
-
-		// Transform into camera relative cordinates
-		Point2 p0 = world_to_camera_space(camera, w0->location);	
-		Point2 p1 = world_to_camera_space(camera, w1->location);	
-		
-		// Don't render walls if behind the camera
-		if (!clip_to_frustum(&p0, &p1, 0.4)) continue;
-		
-		// Project wall endpoints to screen space
-		Point2 w0_upper = camera_to_pixel_space(p0, room->z1 - camera->z, h, w, FOV);
-		Point2 w0_lower = camera_to_pixel_space(p0, room->z0 - camera->z, h, w, FOV);
-		Point2 w1_upper = camera_to_pixel_space(p1, room->z1 - camera->z, h, w, FOV);
-		Point2 w1_lower = camera_to_pixel_space(p1, room->z0 - camera->z, h, w, FOV);
-
-		Point2 uv0_upper = get_texture_cordinates(camera_to_world_space(camera, p0), room->z1);
-		Point2 uv0_lower = get_texture_cordinates(camera_to_world_space(camera, p0), room->z0);
-		Point2 uv1_upper = get_texture_cordinates(camera_to_world_space(camera, p1), room->z1);
-		Point2 uv1_lower = get_texture_cordinates(camera_to_world_space(camera, p1), room->z0);
-		
-		// In the case of portals, do some more projection to find where the top and bottom portions of the portal should be
-		Point2 portal0_lower, portal0_upper, portal1_lower, portal1_upper;
-		if (w0->portal_idx != -1) {
-			int portal = w0->portal_idx;
-			float bottom_height = MAX(0, map->rooms[portal]->z0 - room->z0);
-			float top_height = MAX(0, room->z1 - map->rooms[portal]->z1);
-			portal0_lower = camera_to_pixel_space(p0, room->z0 - camera->z + bottom_height, h, w, FOV);
-			portal0_upper = camera_to_pixel_space(p0, room->z1 - camera->z - top_height, h, w, FOV);
-			portal1_lower = camera_to_pixel_space(p1, room->z0 - camera->z + bottom_height, h, w, FOV);
-			portal1_upper = camera_to_pixel_space(p1, room->z1 - camera->z - top_height, h, w, FOV);
-		}
-
-		// Limit the draw portion of the wall to the screen
-		float x0 = MAX((float)x_min, w0_upper.x);
-		float x1 = MIN((float)x_max, w1_upper.x);
-		
-		// Dont draw walls facing away from the player, or with zero size.
-		if (x0 >= x1) continue;
-
-		// For every pixel along the wall, draw the floor, ceiling, and the wal
-		for (int x = x0; x < x1; x++) {
-			int pixels_drawn = x - (int)w0_upper.x;
-			float part_drawn = (float)pixels_drawn / (w1_upper.x - w0_upper.x);
-
-			// Interpolate the start and end y cordinates
-			float y0_unclamped = lerp(w0_upper.y, w1_upper.y, part_drawn);
-			float y1_unclamped = lerp(w0_lower.y, w1_lower.y, part_drawn);
-
-			Point2 uv_upper = {
-				.x = lerp(uv0_upper.x, uv1_upper.x, part_drawn),
-				.y = lerp(uv0_upper.y, uv1_upper.y, part_drawn),
-			};
-			Point2 uv_lower = {
-				.x = lerp(uv0_lower.x, uv1_lower.x, part_drawn),
-				.y = lerp(uv0_lower.y, uv1_lower.y, part_drawn),
-			};
-
-			// Limit them to within the y bounds
-			float y0 = MAX(y_min[x], y0_unclamped);
-			float y1 = MIN(y_max[x], y1_unclamped);
-
-			// Draw in the floor and ceiling, and in the case of a normal wall, draw it in.
-			vline(canvas, x, y_min[x], y0, 0, 0, 64);
-			vline(canvas, x, y1, y_max[x], 64, 64, 64);
-			if (w0->portal_idx == -1) {
-//				if (w0->texture != -1) {
-//					textured_vline(canvas, x, y0, y1, y0_unclamped, y1_unclamped, uv_upper.x, uv_upper.y, uv_lower.y, textures[w0->texture]);
-//					textured_vline(canvas, x, y0, y1, y0_unclamped, y1_unclamped, part_drawn, 1, 0, textures[w0->texture]);
-//				} else {
-					vline(canvas, x, y0, y1, w0->r, w0->g, w0->b);
-//				}
-			}
-
-			// In the case of a portal, draw the upper and lower segments
-			if (w0->portal_idx != -1) {
-				// Interpolate the y of the top and bottom of the portal
-				float top_y = lerp(portal0_upper.y, portal1_upper.y, part_drawn);
-				float bottom_y = lerp(portal0_lower.y, portal1_lower.y, part_drawn);
-				
-				// Limit to the bounds
-				top_y = MAX(top_y, y_min[x]); bottom_y = MIN(bottom_y, y_max[x]);
-				
-				// Draw the top and bottom
-				vline(canvas, x, y0, top_y, w0->r, w0->g, w0->b);
-				vline(canvas, x, bottom_y, y1, w0->r, w0->g, w0->b);
-			
-				// Update the bounds
-				y_min[x] = top_y;
-				y_max[x] = bottom_y;
-			}
-
-			if (slow_render) {
-				window_present(*window);
-				SDL_Delay(10);
-			}
-		}
-		
-		if (w0->portal_idx != -1) {
-			// Recurse to draw objects beond a portal
-			// The x bounds are simply the space that the portal would have been drawn in if it was a wall
-			// The y bounds are set while drawing the floor, ceiling and top and bottom sections.
-			render_room(window, camera, w0->portal_idx, map, x0, x1, y_min, y_max);
-		}
-	}
-}
-
-/////////////
-// UI code //
-/////////////
-
-void do_input(struct Map* map, struct Camera* camera) {
+// Handle window events and key presses
+void do_events() {
 	// Check if the user wants to close the window
 	SDL_Event event;
 	while (SDL_PollEvent(&event)) {
@@ -369,129 +183,274 @@ void do_input(struct Map* map, struct Camera* camera) {
 				break;
 			case SDL_KEYDOWN:
 				if (event.key.keysym.scancode == SDL_SCANCODE_TAB) {
-					slow_render ^= 1;
+					slow_render_toggled = 1;
+				}
+				if (event.key.keysym.scancode == SDL_SCANCODE_F1) {
+					show_stats ^= 1;
+					view_changed = 1;
+				}
+				if (event.key.keysym.scancode == SDL_SCANCODE_F2) {
+					overdraw ^= 1;
+					view_changed = 1;
+				}
+				// Start or stop writing the stats of every frame to stats.csv
+				if (event.key.keysym.scancode == SDL_SCANCODE_F3) {
+					if (stats_csv) {
+						fclose(stats_csv);
+						stats_csv = NULL;
+						printf("Stopped recording stats\n");
+					} else if ((stats_csv = fopen("stats.csv", "w"))) {
+						stats_csv_header(stats_csv);
+						printf("Recording stats to stats.csv\n");
+					}
+				}
+				// Start or stop recording frames to capture.y4m
+				if (event.key.keysym.scancode == SDL_SCANCODE_F4) {
+					capture_toggled = 1;
+				}
+				// Start or stop recording a demo to demo.dem
+				if (event.key.keysym.scancode == SDL_SCANCODE_F5) {
+					demo_toggled = 1;
+				}
+				break;
+			case SDL_WINDOWEVENT:
+				if (event.window.event == SDL_WINDOWEVENT_EXPOSED) {
+					window_exposed = 1;
 				}
 				break;
 		}
 	}
-	
+}
+
+// Find which keys the player is holding down, the simulation moves the camera with them every tick
+int read_keys() {
 	uint8_t* keyboard = SDL_GetKeyboardState(NULL);
-	
-	// Handle rotation inputs
-	if (keyboard[SDL_SCANCODE_Q]) {
-		camera->angle -= 0.05;
-	}
-	if (keyboard[SDL_SCANCODE_E]) {
-		camera->angle += 0.05;
-	}
+	int keys = 0;
+	if (keyboard[SDL_SCANCODE_W]) keys |= KEY_FORWARD;
+	if (keyboard[SDL_SCANCODE_S]) keys |= KEY_BACK;
+	if (keyboard[SDL_SCANCODE_A]) keys |= KEY_LEFT;
+	if (keyboard[SDL_SCANCODE_D]) keys |= KEY_RIGHT;
+	if (keyboard[SDL_SCANCODE_Q]) keys |= KEY_TURN_LEFT;
+	if (keyboard[SDL_SCANCODE_E]) keys |= KEY_TURN_RIGHT;
+	return keys;
+}
 
-	// Vector to store movement intent
-	// The camera is facing y+.
-	Point2 translation = {0, 0};
-	if (keyboard[SDL_SCANCODE_W]) {
-		translation.y += 0.1;
-	}
-	if (keyboard[SDL_SCANCODE_S]) {
-		translation.y -= 0.1;
-	}
-	if (keyboard[SDL_SCANCODE_A]) {
-		translation.x -= 0.1;
-	}
-	if (keyboard[SDL_SCANCODE_D]) {
-		translation.x += 0.1;
-	}
 
-	Point2 old_location = camera->location;
-	// Simple function to check collisions between old_location and camera->location,
-	// updateing camera->location and camera->room_idx as needed
-	void check_collide() {
-		int collision = room_collide(map->rooms[camera->room_idx], camera->location, old_location, NULL);
-		if (collision != -1) {
-			struct WallVertex wall = map->rooms[camera->room_idx]->walls[collision];
-			if (wall.portal_idx != -1) {
-				// Portal, allow movement, but update roomidx
-				camera->room_idx = wall.portal_idx;
-			} else {
-				// Wall, ignore movement
-				camera->location = old_location;
-			}
-		}
+// Load an image with SDL_image, for load_map_textures
+uint32_t* load_image(const char* path, int* w, int* h) {
+	SDL_Surface* loaded = IMG_Load(path);
+	if (!loaded) {
+		printf("Failed to load texture %s, using a placeholder\n", path);
+		return NULL;
 	}
-
-	// Movement is split between the x and y directions so that the player doesnt get snagged on walls	
-	float angle = -camera->angle;
-	camera->location.x += translation.x * cos(angle) - translation.y * sin(angle);
-	
-	check_collide();
-	old_location = camera->location;
-
-	camera->location.y += translation.x * sin(angle) + translation.y * cos(angle);
-	
-	check_collide();
-
-	// Update camera z to be 1 unit above the floor.
-	camera->z = map->rooms[camera->room_idx]->z0 + 1;
+	SDL_Surface* image = SDL_ConvertSurfaceFormat(loaded, SDL_PIXELFORMAT_RGBA8888, 0);
+	SDL_FreeSurface(loaded);
+	if (!image) return NULL;
+
+	// Copy out the rows, since the surface may have padding between them
+	uint32_t* pixels = malloc(sizeof(uint32_t) * image->w * image->h);
+	for (int y = 0; y < image->h; y++)
+		memcpy(&pixels[y * image->w], (char*)image->pixels + y * image->pitch, sizeof(uint32_t) * image->w);
+	*w = image->w;
+	*h = image->h;
+	SDL_FreeSurface(image);
+	return pixels;
 }
 
-
-
 int main(int argc, char** argv) {
-	if (argc != 2) {
-		printf("Usage: %s [mapfile]\n", argv[0]);
+	if (argc < 2 || argc > 5) {
+		printf("Usage: %s [mapfile] [frame time ms] [streaming memory MB, 0 to load it all] [ticks per second]\n", argv[0]);
 		return 1;
 	}
 
-	//textures[1] = IMG_Load("textures/stone.png");
-	//textures[0] = IMG_Load("textures/wood.png");
-
-	//assert(textures[0]);
-	//assert(textures[1]);
-
-	//textures[0] = SDL_ConvertSurfaceFormat(textures[0], SDL_PIXELFORMAT_RGBA8888, 0);
-	//textures[1] = SDL_ConvertSurfaceFormat(textures[1], SDL_PIXELFORMAT_RGBA8888, 0);
-
 	char* mapfile = argv[1];
+	// The resolution is lowered if rendering a frame takes longer than this, and raised again, up to the window's resolution, if it is faster.
+	double target_ms = argc > 2 ? atof(argv[2]) : 10;
+	ResolutionScaler scaler = resolution_scaler(target_ms / 1000, 0.2);
+	double tick_rate = argc > 4 ? atof(argv[4]) : 60;
+	if (tick_rate <= 0) {
+		printf("Ticks per second must be positive\n");
+		return 1;
+	}
 
 	// Open a window,
 	Window window = window_open();
+	debug_window = &window;
 	
-	struct Map* map = load_map_from_file(fopen(mapfile, "r"));
-	struct Camera camera = {.location = map->starting_location, .room_idx=map->starting_room, .z=0};
+	// With a memory limit, a binary map is streamed in around the camera instead of loaded all at once
+	WorldStream* stream = NULL;
+	struct Map* map;
+	if (argc > 3 && atof(argv[3]) > 0) {
+		stream = stream_open(mapfile, atof(argv[3]) * 1024 * 1024, 4);
+		if (!stream) return 1;
+		map = stream_map(stream);
+	} else {
+		map = load_map(mapfile);
+		if (!map) return 1;
+	}
+	load_map_textures(map, load_image);
+	struct Camera camera = {0};
+	place_camera(map, &camera, map->starting_location, map->starting_room);
+	// The camera is moved by the simulation, and drawn between its last two ticks
+	Simulation sim = simulation_create(camera, tick_rate);
+	uint64_t last_time = SDL_GetPerformanceCounter();
+
+	// Render with every core
+	RenderPool* pool = render_pool_create(SDL_GetCPUCount());
+	// Used for slow rendering, which can't use the pool
+	RenderContext* context = render_context_create();
+	render_context_debug_hook(context, slow_render_hook);
+	// Tracks what is on the canvas, so only what changed is drawn
+	Redraw* redraw = redraw_create();
+
+	// Frames are drawn into canvases[back] in the background while the last frame is shown from the other canvas.
+	int back = 0;
+	// Set while a frame is being drawn, with what it was drawn with
+	int drawing = 0;
+	struct Camera drawing_camera;
+	int drawing_x_min = 0, drawing_x_max = 0;
+	// Frames drawn, for the stats file
+	int frame = 0;
 
 	while (1) {
-		// Handle inputs
-		do_input(map, &camera);
+		// Handle inputs, and run the ticks due since the last time around
+		do_events();
+		uint64_t time = SDL_GetPerformanceCounter();
+		int keys = read_keys();
+		int ticks = simulation_update(&sim, map, player_input(keys), (double)(time - last_time) / SDL_GetPerformanceFrequency());
+		last_time = time;
+		if (demo) demo_record(demo, keys, ticks);
+
+		// Recording starts from the camera after the last tick, so playing the demo back runs the same ticks from the same place
+		if (demo_toggled) {
+			if (demo) {
+				if (demo_save(demo, "demo.dem")) printf("Failed to save demo.dem\n");
+				else printf("Saved %lu ticks to demo.dem\n", demo_ticks(demo));
+				demo_free(demo);
+				demo = NULL;
+			} else {
+				demo = demo_create(sim.current, tick_rate, map);
+				printf("Recording a demo\n");
+			}
+			demo_toggled = 0;
+		}
+		camera = simulation_camera(&sim, map);
 			
 		// Sanity check, make sure the player has a valid room
 		assert(map->length > camera.room_idx);
-	
-		// Get size of the window, and ensure that the rendering buffer is the same size.
-		// int h = 720, w = 1020;
-		// SDL_GetRendererOutputSize(window.renderer, &w, &h);
 
-		// Doom resolution :)
-		int h = 640/2, w = 480/2;
-		renderer_setup(&window, h, w);
+		// Finish the frame being drawn, it is shown below while the next one is drawn
+		int finished = drawing;
+		int finished_x_min = drawing_x_min, finished_x_max = drawing_x_max;
+		if (drawing) {
+			render_pool_wait(pool);
+			int threads = render_pool_threads(pool);
+			RenderContext* contexts[threads];
+			for (int i = 0; i < threads; i++) contexts[i] = render_pool_context(pool, i);
+			redraw_record(redraw, contexts, threads, window.canvases[back], &drawing_camera, map, drawing_x_min, drawing_x_max);
+
+			// Only whole frames are used to pick the resolution, partly drawn ones are quicker than the resolution can keep up
+			Canvas* finished_canvas = window.canvases[back];
+			if (drawing_x_min == 0 && drawing_x_max == finished_canvas->w) resolution_update(&scaler, render_pool_frame_time(pool));
+
+			RenderStats stats = stats_sum(contexts, threads);
+			double ms = render_pool_frame_time(pool) * 1000;
+			if (stats_csv) stats_csv_row(stats_csv, frame++, ms, &stats);
+			if (show_stats) stats_draw(window.canvases[back], &stats, ms);
+			if (capture) capture_frame(capture, window.canvases[back]);
+			back ^= 1;
+			drawing = 0;
+		}
+
+		// The pool has finished with the canvases, so slow rendering can take over drawing them on this thread
+		if (slow_render_toggled) {
+			slow_render ^= 1;
+			slow_render_toggled = 0;
+		}
+
+		// Nothing is drawing the map now, so rooms can be streamed in and out
+		if (stream) stream_update(stream, &camera);
 	
-		// Fill viewport with hot pink to make unrendered areas easly visiable
-		SDL_FillRect(window.canvas, NULL, 0xff00ffff);
-
-		// Render to the canvas surface
-		SDL_LockSurface(window.canvas);
-		// Initalize bounds for rendering
-		int* y0 = malloc(sizeof(int) * w);
-		int* y1 = malloc(sizeof(int) * w);
-		for (int i = 0; i < w; i++) y0[i] = 0;
-		for (int i = 0; i < w; i++) y1[i] = h;
-		// Render!
-		render_room(&window, &camera, camera.room_idx, map, 0, w, y0, y1);
-		// Clean up
-		free(y0); free(y1);
-		SDL_UnlockSurface(window.canvas);
-		
-		window_present(window);
+		// Get size of the window, and ensure that the rendering buffers are big enough for it.
+		int screen_w, screen_h;
+		SDL_GetRendererOutputSize(window.renderer, &screen_w, &screen_h);
+		if (renderer_setup(&window, screen_w, screen_h)) {
+			redraw_invalidate(redraw);
+			finished = 0;
+		}
+
+		// Render at the resolution the scaler picked, the canvas only uses part of its pixels if it is smaller than the window.
+		// A canvas with a new size doesn't match what the redraw tracking saw, so it is drawn in full.
+		int w, h;
+		resolution_size(&scaler, screen_w, screen_h, &w, &h);
+		window.canvases[back]->w = w;
+		window.canvases[back]->h = h;
+
+		// Apply the debug flags, the overlay is drawn over the frame so it needs whole frames drawn while it is shown.
+		if (view_changed) {
+			RenderSettings settings = RENDER_DEFAULT_SETTINGS;
+			settings.overdraw = overdraw;
+			render_pool_settings(pool, settings);
+			render_context_settings(context, settings);
+			view_changed = 0;
+			redraw_invalidate(redraw);
+		}
+		if (show_stats) redraw_invalidate(redraw);
+
+		// Start or stop capturing at the size of the window, frames at lower resolutions are scaled up to it.
+		// Only part of a canvas is drawn if only part of the frame changed, so whole frames are drawn while capturing.
+		if (capture_toggled) {
+			if (capture) {
+				CaptureStats counts = capture_close(capture);
+				capture = NULL;
+				printf("Stopped capturing, %lu frames written, %lu dropped\n", counts.written, counts.dropped);
+			} else if ((capture = capture_open("capture.y4m", screen_w, screen_h, 60, 8))) {
+				printf("Capturing frames to capture.y4m\n");
+			}
+			capture_toggled = 0;
+		}
+		if (capture) redraw_invalidate(redraw);
+
+		// Slow rendering presents whole canvases from inside the renderer, so it draws whole frames on this thread.
+		if (slow_render) {
+			Canvas* canvas = window.canvases[back];
+			render_frame(context, canvas, &camera, map);
+			redraw_invalidate(redraw);
+			window_present(&window, canvas, 0, canvas->w);
+			window_exposed = 0;
+			back ^= 1;
+			continue;
+		}
+
+		// Start drawing the next frame if anything changed
+		if (redraw_columns(redraw, window.canvases[back], &camera, map, &drawing_x_min, &drawing_x_max)) {
+			drawing_camera = camera;
+			render_pool_begin(pool, window.canvases[back], &drawing_camera, map, drawing_x_min, drawing_x_max);
+			drawing = 1;
+		}
+
+		// Show the finished frame while the next one is drawn.
+		// The canvases are only looked up now, renderer_setup may have replaced them, in which case the finished frame was lost with them.
+		if (finished) {
+			window_present(&window, window.canvases[back ^ 1], finished_x_min, finished_x_max);
+			window_exposed = 0;
+		} else if (window_exposed) {
+			window_present(&window, NULL, 0, 0);
+			window_exposed = 0;
+		} else if (!drawing) {
+			// Nothing changed, so keep showing the last frame, and sleep until there is input
+			SDL_WaitEventTimeout(NULL, 100);
+			// Nothing was moving while waiting, so the time waited isn't simulated, or a key pressed to wake up would be applied for all of it
+			last_time = SDL_GetPerformanceCounter();
+		}
 	}
 
-	free_map(map);
+	if (stats_csv) fclose(stats_csv);
+	if (capture) capture_close(capture);
+	redraw_free(redraw);
+	render_pool_free(pool);
+	render_context_free(context);
+	if (stream) stream_close(stream);
+	else free_map(map);
 	return 0;
 }
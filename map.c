@@ -1,30 +1,291 @@
 // Structures and functions for working with 3d geometry
+#define _POSIX_C_SOURCE 200809L
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <assert.h>
 #include <math.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sched.h>
 #include "map.h"
+#include "grid.h"
+#include "texture.h"
 
 // Allocated a room with capacity for n Rooms
 struct Room* allocate_room(int length) {
 	struct Room* room = malloc(sizeof(struct Room) + sizeof(struct WallVertex) * length);
 	room->length = length;
+	room->floor_texture = -1;
+	room->ceiling_texture = -1;
+	room->light = 255;
 	return room;
 }
 
+struct Room map_missing_room = {.floor_texture = -1, .ceiling_texture = -1, .light = 0, .length = 0};
+
 struct Map* allocate_map(int length) {
 	struct Map* map = malloc(sizeof(struct Map) + sizeof(struct Room*) * length);
 	map->length = length;
+	map->mapping = NULL;
+	map->mapping_size = 0;
+	map->pvs = NULL;
+	map->pvs_bits = NULL;
+	map->pvs_bits_length = 0;
+	map->grid = NULL;
+	map->bounds_low = (Point2) {INFINITY, INFINITY};
+	map->bounds_high = (Point2) {-INFINITY, -INFINITY};
+	memset(&map->walls, 0, sizeof(struct MapWalls));
+	map->texture_paths = NULL;
+	map->texture_count = 0;
+	map->textures = NULL;
+	map->revision = 0;
+	map->room_revision = calloc(length ? length : 1, sizeof(uint64_t));
+	map->layout_revision = 0;
+	map->entities = calloc(length ? length : 1, sizeof(struct RoomEntities));
 	return map;
 }
 
+//////////////////
+// Packed walls //
+//////////////////
+
+void free_map_walls(struct MapWalls* walls) {
+	free(walls->slot_start);
+	free(walls->x);
+	free(walls->y);
+	free(walls->color);
+	free(walls->texture);
+	free(walls->portal);
+	free(walls->length);
+	free(walls->step_bottom);
+	free(walls->step_top);
+	free(walls->packed);
+	memset(walls, 0, sizeof(struct MapWalls));
+}
+
+// States of a room's slot in MapWalls.packed
+enum {
+	WALLS_UNPACKED,
+	// A thread drawing the room is filling it in
+	WALLS_PACKING,
+	WALLS_PACKED,
+};
+
+// Work out the steps up to the room behind the packed wall i of a room, returns 1 if they changed
+int pack_steps(struct Map* map, struct Room* room, int i) {
+	struct MapWalls* walls = &map->walls;
+	float bottom = 0, top = 0;
+	if (walls->portal[i] != -1) {
+		struct Room* behind = map->rooms[walls->portal[i]];
+		bottom = MAX(0, behind->z0 - room->z0);
+		top = MAX(0, room->z1 - behind->z1);
+	}
+	int changed = walls->step_bottom[i] != bottom || walls->step_top[i] != top;
+	walls->step_bottom[i] = bottom;
+	walls->step_top[i] = top;
+	return changed;
+}
+
+// Copy a room's walls into its slot, the slot must be big enough.
+// The rest of the slot is left with no portals, so the slot's portals are always the ones the room has.
+void pack_room(struct Map* map, int roomid) {
+	struct MapWalls* walls = &map->walls;
+	struct Room* room = map->rooms[roomid];
+	int start = walls->slot_start[roomid];
+	for (int j = 0; j < room->length; j++) {
+		struct WallVertex* wall = &room->walls[j];
+		Point2 next = room->walls[j + 1 < room->length ? j + 1 : 0].location;
+		int i = start + j;
+		walls->x[i] = wall->location.x;
+		walls->y[i] = wall->location.y;
+		walls->color[i] = (uint32_t)(wall->r & 0xff) << 24 | (wall->g & 0xff) << 16 | (wall->b & 0xff) << 8 | 0xff;
+		walls->texture[i] = wall->texture >= 0 && wall->texture < INT16_MAX ? wall->texture : -1;
+		walls->portal[i] = wall->portal_idx;
+		walls->length[i] = hypot(next.x - wall->location.x, next.y - wall->location.y);
+		pack_steps(map, room, i);
+	}
+	for (int i = start + room->length; i < walls->slot_start[roomid + 1]; i++) walls->portal[i] = -1;
+}
+
+// Lay out the slots again, every room is packed again when it is next drawn.
+// Each slot is as big as the room in it, or as it was before if that is bigger, so a room streamed out keeps its space.
+// The arrays are left as they come from malloc, so the pages of rooms that are never drawn are never touched.
+void layout_walls(struct Map* map) {
+	struct MapWalls* walls = &map->walls;
+	int* old = walls->slot_start;
+	int* start = malloc(sizeof(int) * (map->length + 1));
+	int total = 0;
+	for (int i = 0; i < map->length; i++) {
+		start[i] = total;
+		total += old ? MAX(map->rooms[i]->length, old[i + 1] - old[i]) : map->rooms[i]->length;
+	}
+	start[map->length] = total;
+
+	free_map_walls(walls);
+	int size = total ? total : 1;
+	walls->slot_start = start;
+	walls->x = malloc(sizeof(float) * size);
+	walls->y = malloc(sizeof(float) * size);
+	walls->color = malloc(sizeof(uint32_t) * size);
+	walls->texture = malloc(sizeof(int16_t) * size);
+	walls->portal = malloc(sizeof(int32_t) * size);
+	walls->length = malloc(sizeof(float) * size);
+	walls->step_bottom = malloc(sizeof(float) * size);
+	walls->step_top = malloc(sizeof(float) * size);
+	walls->packed = calloc(map->length ? map->length : 1, 1);
+	walls->revision = map->revision;
+
+	// The grid lists walls by their slots, which have all moved
+	free_map_grid(map->grid);
+	map->grid = NULL;
+}
+
+void map_pack_walls(struct Map* map, int roomid) {
+	unsigned char* state = &map->walls.packed[roomid];
+	if (__atomic_load_n(state, __ATOMIC_ACQUIRE) == WALLS_PACKED) return;
+	unsigned char unpacked = WALLS_UNPACKED;
+	if (__atomic_compare_exchange_n(state, &unpacked, WALLS_PACKING, 0, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+		pack_room(map, roomid);
+		__atomic_store_n(state, WALLS_PACKED, __ATOMIC_RELEASE);
+		return;
+	}
+	// Another thread got to it first, a room only takes a moment to pack
+	while (__atomic_load_n(state, __ATOMIC_ACQUIRE) != WALLS_PACKED) sched_yield();
+}
+
+// Pack the steps of every wall in the rooms neighbour has portals to that leads back into it.
+// Portals go both ways, so these are all the walls with steps up to neighbour. Rooms whose steps changed are redrawn.
+// Rooms that aren't packed yet are left alone, they get the new steps when they are.
+void repack_neighbour_steps(struct Map* map, int roomid) {
+	struct MapWalls* walls = &map->walls;
+	for (int i = walls->slot_start[roomid]; i < walls->slot_start[roomid + 1]; i++) {
+		int other = walls->portal[i];
+		if (other == -1 || walls->packed[other] != WALLS_PACKED) continue;
+		for (int j = walls->slot_start[other]; j < walls->slot_start[other + 1]; j++)
+			if (walls->portal[j] == roomid && pack_steps(map, map->rooms[other], j)) map->room_revision[other] = map->revision;
+	}
+}
+
+// Pack a room again after it changed, along with the steps up to it from the rooms next to it
+void repack_room(struct Map* map, int roomid) {
+	struct MapWalls* walls = &map->walls;
+	// Nothing is packed until the map is finished loading
+	if (!walls->slot_start) return;
+	if (map->rooms[roomid]->length > walls->slot_start[roomid + 1] - walls->slot_start[roomid]) {
+		// Every wall moves, so every frame has to be drawn again
+		map->layout_revision = map->revision;
+		layout_walls(map);
+		return;
+	}
+	// The rooms it had portals to before it changed, which are only known if it was packed, then the ones it has now
+	if (walls->packed[roomid] == WALLS_PACKED) repack_neighbour_steps(map, roomid);
+	pack_room(map, roomid);
+	walls->packed[roomid] = WALLS_PACKED;
+	repack_neighbour_steps(map, roomid);
+}
+
+void map_changed(struct Map* map) {
+	map->layout_revision = ++map->revision;
+	layout_walls(map);
+}
+
+void map_room_changed(struct Map* map, int roomid, int moved) {
+	map->room_revision[roomid] = ++map->revision;
+	if (moved) map->layout_revision = map->revision;
+	repack_room(map, roomid);
+	if (moved) map_grid_update_room(map, roomid);
+}
+
+void map_room_replaced(struct Map* map, int roomid) {
+	map->room_revision[roomid] = ++map->revision;
+	repack_room(map, roomid);
+	map_grid_update_room(map, roomid);
+}
+
+int map_add_entity(struct Map* map, int roomid, struct Entity entity) {
+	struct RoomEntities* list = &map->entities[roomid];
+	if (list->length == list->capacity) {
+		list->capacity = MAX(list->capacity * 2, 4);
+		list->entities = realloc(list->entities, sizeof(struct Entity) * list->capacity);
+	}
+	list->entities[list->length] = entity;
+	map_room_changed(map, roomid, 0);
+	return list->length++;
+}
+
+void map_remove_entity(struct Map* map, int roomid, int index) {
+	struct RoomEntities* list = &map->entities[roomid];
+	list->entities[index] = list->entities[--list->length];
+	map_room_changed(map, roomid, 0);
+}
+
+void map_move_entity(struct Map* map, int* roomid, int* index, Point2 location) {
+	struct Entity* entity = &map->entities[*roomid].entities[*index];
+	entity->location = location;
+
+	// Only look for a new room if the entity left its room, which is rare compared to moving inside of it
+	if (room_contains(map->rooms[*roomid], location)) {
+		map_room_changed(map, *roomid, 0);
+		return;
+	}
+	int new_room = map_locate(map, location);
+	if (new_room == -1) {
+		map_room_changed(map, *roomid, 0);
+		return;
+	}
+	struct Entity moved = *entity;
+	map_remove_entity(map, *roomid, *index);
+	*index = map_add_entity(map, new_room, moved);
+	*roomid = new_room;
+}
+
 void free_room(struct Room* room) {
 	free(room);
 }
 
+int in_mapping(struct Map* map, void* pointer);
+
+void free_pvs(struct Map* map) {
+	// A PVS loaded from a binary map file points into the mapping
+	if (!in_mapping(map, map->pvs)) {
+		free(map->pvs);
+		free(map->pvs_bits);
+	}
+	map->pvs = NULL;
+	map->pvs_bits = NULL;
+	map->pvs_bits_length = 0;
+}
+
+// Check if a pointer is inside the mapping of a binary map file
+int in_mapping(struct Map* map, void* pointer) {
+	char* mapping = map->mapping;
+	return mapping && (char*)pointer >= mapping && (char*)pointer < mapping + map->mapping_size;
+}
+
 void free_map(struct Map* map) {
+	free_pvs(map);
+	free_map_grid(map->grid);
+	free_map_walls(&map->walls);
+	texture_atlas_free(map->textures);
+	for (int i = 0; i < map->texture_count; i++)
+		if (!in_mapping(map, map->texture_paths[i])) free(map->texture_paths[i]);
+	free(map->texture_paths);
+	free(map->room_revision);
+	for (int i = 0; i < map->length; i++) free(map->entities[i].entities);
+	free(map->entities);
+	// Rooms in a mapped file are not allocated individualy
+	if (map->mapping) {
+		munmap(map->mapping, map->mapping_size);
+		printf("Map Freed\n");
+		free(map);
+		return;
+	}
 	for (int i = 0; i < map->length; i++) {
+		if (map->rooms[i] == &map_missing_room) continue;
 		printf("Room Freed\n");
 		free_room(map->rooms[i]);
 	}
@@ -64,13 +325,14 @@ struct Map* new_test_map() {
 
 	struct Map* map = allocate_map(1);
 	map->rooms[0] = room1;
+	map_changed(map);
 	return map;
 }
 
 // TODO Sainly handle errors insead of exiting.
 struct Map* load_map_from_file(FILE* file) {
 	char* line;
-	int length;
+	size_t length;
 	int read;
 
 	struct Map* map = NULL;
@@ -78,6 +340,15 @@ struct Map* load_map_from_file(FILE* file) {
 	struct Room* room = NULL;
 	int next_wall = 0;
 
+	// Entities can be listed before the rooms they are in, so they are kept here until the end
+	int* entity_rooms = NULL;
+	struct Entity* entities = NULL;
+	int entity_count = 0;
+
+	// Textures can be listed before the map is created, so they are kept here until the end
+	char** texture_paths = NULL;
+	int texture_count = 0;
+
 	// For every line in the file...
 	while (1) {
 		line = NULL;
@@ -88,7 +359,23 @@ struct Map* load_map_from_file(FILE* file) {
 		if (!strncmp("#", line, strlen("#"))) {
 			// Comment, ignore.
 		} else if (!strncmp("TEXTURE ", line, strlen("TEXTURE "))) {
-			// TODO load textures
+			// Store the path, the textures themselfs are loaded by load_map_textures
+			char* path = strdup(line + strlen("TEXTURE "));
+			path[strcspn(path, "\r\n")] = 0;
+			texture_paths = realloc(texture_paths, sizeof(char*) * (texture_count + 1));
+			texture_paths[texture_count++] = path;
+		} else if (!strncmp("ENTITY ", line, strlen("ENTITY "))) {
+			// An entity, given as the room it is in, its location and height, its size, and optionaly a texture
+			struct Entity entity = {.texture = -1};
+			int roomid;
+			assert(sscanf(
+				line, "ENTITY %d %f %f %f %f %f %d\n", &roomid, &entity.location.x, &entity.location.y,
+				&entity.z, &entity.width, &entity.height, &entity.texture
+			) >= 6);
+			entity_rooms = realloc(entity_rooms, sizeof(int) * (entity_count + 1));
+			entities = realloc(entities, sizeof(struct Entity) * (entity_count + 1));
+			entity_rooms[entity_count] = roomid;
+			entities[entity_count++] = entity;
 		} else if (!strncmp("MAP ", line, strlen("MAP "))) {
 			// Ensure a map has not already been created
 			assert(!map);
@@ -110,12 +397,14 @@ struct Map* load_map_from_file(FILE* file) {
 			// Allocate the room
 			int room_size;
 			float z0 = -1, z1 = 1;
-			int floor_texture = -1;
-			assert(sscanf(line, "ROOM %d %f %f %d\n", &room_size, &z0, &z1, &floor_texture) >= 1);
+			int floor_texture = -1, ceiling_texture = -1, light = 255;
+			assert(sscanf(line, "ROOM %d %f %f %d %d %d\n", &room_size, &z0, &z1, &floor_texture, &ceiling_texture, &light) >= 1);
 			room = allocate_room(room_size);
+			room->light = MIN(MAX(light, 0), 255);
 			room->z0 = z0;
 			room->z1 = z1;
 			room->floor_texture = floor_texture;
+			room->ceiling_texture = ceiling_texture;
 
 			// Append room to the map
 			map->rooms[next_room++] = room;	
@@ -128,7 +417,7 @@ struct Map* load_map_from_file(FILE* file) {
 			// Add the wall
 			float x, y;
 			int r,g,b;
-			int texture;
+			int texture = -1;
 			assert(sscanf(line, "WALL %f %f %d %d %d %d\n", &x, &y, &r, &g, &b, &texture) >= 5);
 			room->walls[next_wall].r = r;
 			room->walls[next_wall].g = g;
@@ -152,6 +441,7 @@ struct Map* load_map_from_file(FILE* file) {
 			room->walls[next_wall].g = g;
 			room->walls[next_wall].b = b;
 
+			room->walls[next_wall].texture = -1;
 			room->walls[next_wall].portal_idx = portalidx;
 			room->walls[next_wall].location.x = x;
 			room->walls[next_wall].location.y = y;
@@ -172,10 +462,439 @@ struct Map* load_map_from_file(FILE* file) {
 	// Ensure room was filled
 	if (room) assert(room->length == next_wall);
 
+	map->texture_paths = texture_paths;
+	map->texture_count = texture_count;
+
+	for (int i = 0; i < entity_count; i++) {
+		assert(entity_rooms[i] >= 0 && entity_rooms[i] < map->length);
+		map_add_entity(map, entity_rooms[i], entities[i]);
+	}
+	free(entity_rooms);
+	free(entities);
+	map_changed(map);
+
 	// All done!
 	return map;
 }
 
+/////////////////////
+// Binary map file //
+/////////////////////
+
+// The binary map file is:
+//  - A MapFileHeader
+//  - A table of room_count uint64_t offsets, from the start of the file, to each room
+//  - The rooms, stored exactly as struct Room is in memory, walls included
+//  - The texture paths, as texture_count NUL terminated strings one after another
+//  - The entities, as entity_count struct MapFileEntitys, 4 byte aligned
+//  - Optionaly the PVS, as room_count struct PVSRooms, 8 byte aligned, followed by pvs_bits_length uint64_t words
+// Everything is native endian, and every room is 4 byte aligned, so the rooms can be used directly from a mapping of the file.
+
+#define MAP_MAGIC "3DMP"
+#define MAP_VERSION 7
+
+struct MapFileHeader {
+	char magic[4];
+	uint32_t version;
+	// Size of struct Room and struct WallVertex when the file was written, so a file with a diffrent layout is rejected
+	uint32_t room_size;
+	uint32_t wall_size;
+	uint32_t room_count;
+	int32_t starting_room;
+	float starting_x;
+	float starting_y;
+	// A box around every room, so a streamed map can have a spatial index covering rooms that aren't loaded yet
+	float low_x, low_y, high_x, high_y;
+	// Offset of the PVS in the file, 0 if there is none
+	uint64_t pvs_offset;
+	uint64_t pvs_bits_length;
+	// Offset of the texture paths in the file
+	uint64_t textures_offset;
+	uint32_t texture_count;
+	uint32_t entity_count;
+	// Offset of the entities in the file
+	uint64_t entities_offset;
+	// Size of the whole file, header included
+	uint64_t file_size;
+	// Checksum of everything after the header
+	uint64_t checksum;
+};
+
+// An entity, and the room it is in
+struct MapFileEntity {
+	int32_t room;
+	struct Entity entity;
+};
+
+// Fletcher style checksum over 32 bit words, this is fast enough to check a whole map on every load.
+uint64_t map_checksum(const uint32_t* data, size_t words) {
+	uint64_t sum1 = 0, sum2 = 0;
+	for (size_t i = 0; i < words; i++) {
+		sum1 += data[i];
+		sum2 += sum1;
+	}
+	return sum1 ^ (sum2 << 32 | sum2 >> 32);
+}
+
+size_t room_size(struct Room* room) {
+	return sizeof(struct Room) + sizeof(struct WallVertex) * room->length;
+}
+
+int save_map_binary(struct Map* map, FILE* file) {
+	// Lay out the file
+	size_t offsets_size = sizeof(uint64_t) * map->length;
+	size_t size = sizeof(struct MapFileHeader) + offsets_size;
+	for (int i = 0; i < map->length; i++) size += room_size(map->rooms[i]);
+	size_t textures_offset = size;
+	for (int i = 0; i < map->texture_count; i++) size += strlen(map->texture_paths[i]) + 1;
+	size = (size + 3) & ~(size_t)3;
+	size_t entities_offset = size;
+	size_t entity_count = 0;
+	for (int i = 0; i < map->length; i++) entity_count += map->entities[i].length;
+	size += sizeof(struct MapFileEntity) * entity_count;
+	size_t pvs_offset = 0;
+	if (map->pvs) {
+		size = pvs_offset = (size + 7) & ~(size_t)7;
+		size += sizeof(struct PVSRoom) * map->length + sizeof(uint64_t) * map->pvs_bits_length;
+	}
+
+	char* buffer = calloc(1, size);
+	if (!buffer) return -1;
+	struct MapFileHeader* header = (struct MapFileHeader*)buffer;
+	uint64_t* offsets = (uint64_t*)(buffer + sizeof(struct MapFileHeader));
+
+	// Copy in the rooms
+	size_t offset = sizeof(struct MapFileHeader) + offsets_size;
+	for (int i = 0; i < map->length; i++) {
+		offsets[i] = offset;
+		memcpy(buffer + offset, map->rooms[i], room_size(map->rooms[i]));
+		offset += room_size(map->rooms[i]);
+	}
+	for (int i = 0; i < map->texture_count; i++) {
+		size_t length = strlen(map->texture_paths[i]) + 1;
+		memcpy(buffer + offset, map->texture_paths[i], length);
+		offset += length;
+	}
+	struct MapFileEntity* entities = (struct MapFileEntity*)(buffer + entities_offset);
+	for (int i = 0; i < map->length; i++)
+		for (int j = 0; j < map->entities[i].length; j++)
+			*entities++ = (struct MapFileEntity) {i, map->entities[i].entities[j]};
+	if (map->pvs) {
+		memcpy(buffer + pvs_offset, map->pvs, sizeof(struct PVSRoom) * map->length);
+		memcpy(buffer + pvs_offset + sizeof(struct PVSRoom) * map->length, map->pvs_bits, sizeof(uint64_t) * map->pvs_bits_length);
+	}
+
+	memcpy(header->magic, MAP_MAGIC, 4);
+	header->version = MAP_VERSION;
+	header->room_size = sizeof(struct Room);
+	header->wall_size = sizeof(struct WallVertex);
+	header->room_count = map->length;
+	header->starting_room = map->starting_room;
+	header->starting_x = map->starting_location.x;
+	header->starting_y = map->starting_location.y;
+	Point2 low = map->bounds_low, high = map->bounds_high;
+	for (int i = 0; i < map->length; i++) {
+		struct Room* room = map->rooms[i];
+		for (int j = 0; j < room->length; j++) {
+			Point2 p = room->walls[j].location;
+			low = (Point2) {MIN(low.x, p.x), MIN(low.y, p.y)};
+			high = (Point2) {MAX(high.x, p.x), MAX(high.y, p.y)};
+		}
+	}
+	header->low_x = low.x;
+	header->low_y = low.y;
+	header->high_x = high.x;
+	header->high_y = high.y;
+	header->pvs_offset = pvs_offset;
+	header->pvs_bits_length = map->pvs ? map->pvs_bits_length : 0;
+	header->textures_offset = textures_offset;
+	header->texture_count = map->texture_count;
+	header->entities_offset = entities_offset;
+	header->entity_count = entity_count;
+	header->file_size = size;
+	header->checksum = map_checksum((uint32_t*)(buffer + sizeof(struct MapFileHeader)), (size - sizeof(struct MapFileHeader)) / 4);
+
+	int ok = fwrite(buffer, size, 1, file) == 1;
+	free(buffer);
+	return ok ? 0 : -1;
+}
+
+// Make sure every portal in a room goes to a room in the map
+const char* check_room_portals(struct Room* room, uint32_t room_count) {
+	for (int j = 0; j < room->length; j++) {
+		int portal = room->walls[j].portal_idx;
+		if (portal < -1 || portal >= (int64_t)room_count) return "portal to a missing room";
+	}
+	return NULL;
+}
+
+// Check the parts of the header that don't depend on the rest of the file
+const char* check_map_header(struct MapFileHeader* header, size_t size) {
+	if (memcmp(header->magic, MAP_MAGIC, 4)) return "not a binary map";
+	if (header->version != MAP_VERSION) return "unsupported version";
+	if (header->room_size != sizeof(struct Room) || header->wall_size != sizeof(struct WallVertex)) return "diffrent struct layout";
+	if (header->file_size != size || size % 4) return "wrong file size";
+	if (header->room_count > (size - sizeof(struct MapFileHeader)) / sizeof(uint64_t)) return "room table out of bounds";
+	if (header->room_count > 0 && (header->starting_room < 0 || header->starting_room >= (int64_t)header->room_count)) return "starting room out of bounds";
+	// A map without walls has an empty box, with low above high, any other box has to be finite
+	int empty = header->low_x > header->high_x || header->low_y > header->high_y;
+	if (!empty && !(isfinite(header->low_x) && isfinite(header->low_y) && isfinite(header->high_x) && isfinite(header->high_y))) return "bad bounds";
+	return NULL;
+}
+
+// Check the texture paths, entities and PVS, which come after the rooms.
+// data holds the file from start to the end, start must be 8 byte aligned so the PVS is aligned in data like it is in the file.
+const char* check_map_sections(struct MapFileHeader* header, char* data, uint64_t start, size_t size) {
+	// Every path has to end inside the file
+	if (header->textures_offset < start || header->textures_offset > size) return "textures out of bounds";
+	char* path = data + (header->textures_offset - start);
+	for (uint32_t i = 0; i < header->texture_count; i++) {
+		char* end = memchr(path, 0, data + (size - start) - path);
+		if (!end) return "textures out of bounds";
+		path = end + 1;
+	}
+
+	if (header->entities_offset % 4 || header->entities_offset < start || header->entities_offset > size) return "entities out of bounds";
+	if ((size - header->entities_offset) / sizeof(struct MapFileEntity) < header->entity_count) return "entities out of bounds";
+	struct MapFileEntity* entities = (struct MapFileEntity*)(data + (header->entities_offset - start));
+	for (uint32_t i = 0; i < header->entity_count; i++)
+		if (entities[i].room < 0 || entities[i].room >= (int64_t)header->room_count) return "entity in a missing room";
+
+	if (header->pvs_offset) {
+		if (header->pvs_offset % 8 || header->pvs_offset < start || header->pvs_offset > size) return "PVS out of bounds";
+		uint64_t available = size - header->pvs_offset;
+		if (available / sizeof(struct PVSRoom) < header->room_count) return "PVS out of bounds";
+		available -= sizeof(struct PVSRoom) * header->room_count;
+		if (available / sizeof(uint64_t) < header->pvs_bits_length) return "PVS out of bounds";
+		struct PVSRoom* pvs = (struct PVSRoom*)(data + (header->pvs_offset - start));
+		for (uint32_t i = 0; i < header->room_count; i++) {
+			if (pvs[i].words == PVS_ALL) continue;
+			if (pvs[i].offset > header->pvs_bits_length || pvs[i].words > header->pvs_bits_length - pvs[i].offset) return "PVS out of bounds";
+		}
+	}
+	return NULL;
+}
+
+// Make sure a mapped binary map file is safe to use, returns NULL if it is or a description of the problem.
+const char* check_map_binary(char* data, size_t size) {
+	struct MapFileHeader* header = (struct MapFileHeader*)data;
+	if (size < sizeof(struct MapFileHeader)) return "file too small";
+	const char* error = check_map_header(header, size);
+	if (error) return error;
+	if (map_checksum((uint32_t*)(data + sizeof(struct MapFileHeader)), (size - sizeof(struct MapFileHeader)) / 4) != header->checksum) return "bad checksum";
+
+	uint64_t* offsets = (uint64_t*)(data + sizeof(struct MapFileHeader));
+	for (uint32_t i = 0; i < header->room_count; i++) {
+		if (offsets[i] % 4 || offsets[i] > size - sizeof(struct Room)) return "room out of bounds";
+		struct Room* room = (struct Room*)(data + offsets[i]);
+		if (room->length < 0 || (size - offsets[i] - sizeof(struct Room)) / sizeof(struct WallVertex) < (uint64_t)room->length) return "room out of bounds";
+		error = check_room_portals(room, header->room_count);
+		if (error) return error;
+	}
+	return check_map_sections(header, data, 0, size);
+}
+
+struct Map* load_map_binary(const char* path) {
+	int fd = open(path, O_RDONLY);
+	if (fd == -1) {
+		printf("Failed to open %s\n", path);
+		return NULL;
+	}
+	struct stat info;
+	if (fstat(fd, &info) == -1 || info.st_size < (off_t)sizeof(struct MapFileHeader)) {
+		printf("Invalid binary map %s: file too small\n", path);
+		close(fd);
+		return NULL;
+	}
+
+	// Private mapping, so pages are shared with other processes using the same map until they are written to.
+	size_t size = info.st_size;
+	char* data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) {
+		printf("Failed to map %s\n", path);
+		return NULL;
+	}
+
+	const char* error = check_map_binary(data, size);
+	if (error) {
+		printf("Invalid binary map %s: %s\n", path, error);
+		munmap(data, size);
+		return NULL;
+	}
+
+	struct MapFileHeader* header = (struct MapFileHeader*)data;
+	uint64_t* offsets = (uint64_t*)(data + sizeof(struct MapFileHeader));
+	struct Map* map = allocate_map(header->room_count);
+	map->starting_room = header->starting_room;
+	map->starting_location.x = header->starting_x;
+	map->starting_location.y = header->starting_y;
+	map->bounds_low = (Point2) {header->low_x, header->low_y};
+	map->bounds_high = (Point2) {header->high_x, header->high_y};
+	map->mapping = data;
+	map->mapping_size = size;
+	for (int i = 0; i < map->length; i++) map->rooms[i] = (struct Room*)(data + offsets[i]);
+	if (header->pvs_offset) {
+		map->pvs = (struct PVSRoom*)(data + header->pvs_offset);
+		map->pvs_bits = (uint64_t*)(data + header->pvs_offset + sizeof(struct PVSRoom) * map->length);
+		map->pvs_bits_length = header->pvs_bits_length;
+	}
+
+	// The paths are used directly from the mapping, only the array of them is allocated
+	map->texture_count = header->texture_count;
+	map->texture_paths = malloc(sizeof(char*) * (map->texture_count ? map->texture_count : 1));
+	char* texture_path = data + header->textures_offset;
+	for (int i = 0; i < map->texture_count; i++) {
+		map->texture_paths[i] = texture_path;
+		texture_path += strlen(texture_path) + 1;
+	}
+
+	// Entities move between rooms, so they are copied out into each room's list
+	struct MapFileEntity* entities = (struct MapFileEntity*)(data + header->entities_offset);
+	for (uint32_t i = 0; i < header->entity_count; i++) map_add_entity(map, entities[i].room, entities[i].entity);
+	map_changed(map);
+	return map;
+}
+
+// Read size bytes at offset in a file, returns 0 if all of them were read
+int read_at(int fd, void* buffer, size_t size, uint64_t offset) {
+	char* out = buffer;
+	while (size > 0) {
+		ssize_t got = pread(fd, out, size, offset);
+		if (got <= 0) return -1;
+		out += got;
+		size -= got;
+		offset += got;
+	}
+	return 0;
+}
+
+struct Map* load_map_index(const char* path, struct MapIndex* index) {
+	int fd = open(path, O_RDONLY);
+	if (fd == -1) {
+		printf("Failed to open %s\n", path);
+		return NULL;
+	}
+
+	// Read the header, the room table, and everything after the rooms, which is small next to them
+	struct MapFileHeader header;
+	struct stat info;
+	const char* error = NULL;
+	uint64_t* offsets = NULL;
+	char* sections = NULL;
+	uint64_t sections_start = 0;
+	if (fstat(fd, &info) == -1 || info.st_size < (off_t)sizeof(struct MapFileHeader) || read_at(fd, &header, sizeof(header), 0)) {
+		error = "file too small";
+	} else if (!(error = check_map_header(&header, info.st_size))) {
+		offsets = malloc(sizeof(uint64_t) * (header.room_count ? header.room_count : 1));
+		sections_start = MIN(header.textures_offset, (uint64_t)info.st_size) & ~(uint64_t)7;
+		sections = malloc(info.st_size - sections_start + 1);
+		if (
+			read_at(fd, offsets, sizeof(uint64_t) * header.room_count, sizeof(struct MapFileHeader)) ||
+			read_at(fd, sections, info.st_size - sections_start, sections_start)
+		) {
+			error = "read failed";
+		} else {
+			error = check_map_sections(&header, sections, sections_start, info.st_size);
+		}
+		for (uint32_t i = 0; !error && i < header.room_count; i++)
+			if (offsets[i] % 4 || offsets[i] > info.st_size - sizeof(struct Room)) error = "room out of bounds";
+	}
+	if (error) {
+		printf("Invalid binary map %s: %s\n", path, error);
+		free(offsets);
+		free(sections);
+		close(fd);
+		return NULL;
+	}
+
+	// Every room starts out missing
+	struct Map* map = allocate_map(header.room_count);
+	map->starting_room = header.starting_room;
+	map->starting_location.x = header.starting_x;
+	map->starting_location.y = header.starting_y;
+	for (int i = 0; i < map->length; i++) map->rooms[i] = &map_missing_room;
+
+	// Unlike load_map_binary, nothing is used from a mapping, so everything is copied
+	if (header.pvs_offset) {
+		size_t pvs_size = sizeof(struct PVSRoom) * map->length;
+		map->pvs = malloc(pvs_size ? pvs_size : 1);
+		map->pvs_bits = malloc(sizeof(uint64_t) * (header.pvs_bits_length ? header.pvs_bits_length : 1));
+		map->pvs_bits_length = header.pvs_bits_length;
+		memcpy(map->pvs, sections + (header.pvs_offset - sections_start), pvs_size);
+		memcpy(map->pvs_bits, sections + (header.pvs_offset - sections_start) + pvs_size, sizeof(uint64_t) * header.pvs_bits_length);
+	}
+	map->texture_count = header.texture_count;
+	map->texture_paths = malloc(sizeof(char*) * (map->texture_count ? map->texture_count : 1));
+	char* texture_path = sections + (header.textures_offset - sections_start);
+	for (int i = 0; i < map->texture_count; i++) {
+		map->texture_paths[i] = strdup(texture_path);
+		texture_path += strlen(texture_path) + 1;
+	}
+	struct MapFileEntity* entities = (struct MapFileEntity*)(sections + (header.entities_offset - sections_start));
+	for (uint32_t i = 0; i < header.entity_count; i++) map_add_entity(map, entities[i].room, entities[i].entity);
+	free(sections);
+	map->bounds_low = (Point2) {header.low_x, header.low_y};
+	map->bounds_high = (Point2) {header.high_x, header.high_y};
+
+	// Give every room a slot for its walls big enough for when it is loaded, rooms are written one after another so each ends where the next starts.
+	// The slots are only a guess for a broken file, a room that doesn't fit lays them out again.
+	map->walls.slot_start = malloc(sizeof(int) * (map->length + 1));
+	int slots = 0;
+	for (int i = 0; i < map->length; i++) {
+		uint64_t end = i + 1 < map->length ? offsets[i + 1] : header.textures_offset;
+		map->walls.slot_start[i] = slots;
+		if (end > offsets[i] + sizeof(struct Room)) slots += (end - offsets[i] - sizeof(struct Room)) / sizeof(struct WallVertex);
+	}
+	map->walls.slot_start[map->length] = slots;
+	map_changed(map);
+
+	index->fd = fd;
+	index->offsets = offsets;
+	index->file_size = info.st_size;
+	return map;
+}
+
+struct Room* load_map_room(struct MapIndex* index, int roomid, int room_count) {
+	// Read the room without its walls first, to find how many walls there are
+	struct Room head;
+	uint64_t offset = index->offsets[roomid];
+	if (read_at(index->fd, &head, sizeof(struct Room), offset)) return NULL;
+	if (head.length < 0 || (index->file_size - offset - sizeof(struct Room)) / sizeof(struct WallVertex) < (uint64_t)head.length) return NULL;
+
+	struct Room* room = allocate_room(head.length);
+	if (read_at(index->fd, room, room_size(&head), offset) || check_room_portals(room, room_count)) {
+		free_room(room);
+		return NULL;
+	}
+	return room;
+}
+
+void free_map_index(struct MapIndex* index) {
+	close(index->fd);
+	free(index->offsets);
+}
+
+struct Map* load_map(const char* path) {
+	FILE* file = fopen(path, "r");
+	if (!file) {
+		printf("Failed to open %s\n", path);
+		return NULL;
+	}
+
+	char magic[4];
+	int binary = fread(magic, 4, 1, file) == 1 && !memcmp(magic, MAP_MAGIC, 4);
+	if (binary) {
+		fclose(file);
+		return load_map_binary(path);
+	}
+
+	rewind(file);
+	struct Map* map = load_map_from_file(file);
+	fclose(file);
+	return map;
+}
+
 int room_collide(struct Room* room, Point2 p0, Point2 p1, Point2* point_of_collision) {
 	// For every wall
 	for (int wallidx = 0; wallidx < room->length; wallidx++) {
@@ -186,10 +905,51 @@ int room_collide(struct Room* room, Point2 p0, Point2 p1, Point2* point_of_colli
 		if (wallidx + 1 != room->length) wall1 = &room->walls[wallidx + 1];
 		// Check collisions
 		Point2 intersection = intersect_line_segments(p0, p1, wall0->location, wall1->location);
-		if (isnormal(intersection.x)) {
+		if (!isnan(intersection.x)) {
 			if (point_of_collision) *point_of_collision = intersection;
 			return wallidx;
 		}
 	}
 	return -1;
 }
+
+void place_camera(struct Map* map, struct Camera* camera, Point2 location, int fallback_room) {
+	int room = map_locate(map, location);
+	camera->location = location;
+	camera->room_idx = room != -1 ? room : fallback_room;
+	camera->z = map->rooms[camera->room_idx]->z0 + 1;
+}
+
+void move_camera(struct Map* map, struct Camera* camera, Point2 translation) {
+	Point2 old_location = camera->location;
+	// Simple function to check collisions between old_location and camera->location,
+	// updateing camera->location and camera->room_idx as needed
+	void check_collide() {
+		int collision = map_collide(map, camera->room_idx, camera->location, old_location, NULL);
+		if (collision != -1) {
+			struct WallVertex wall = map->rooms[camera->room_idx]->walls[collision];
+			if (wall.portal_idx != -1 && map->rooms[wall.portal_idx] != &map_missing_room) {
+				// Portal, allow movement, but update roomidx
+				camera->room_idx = wall.portal_idx;
+			} else {
+				// Wall, or a portal to a room that hasn't been streamed in yet, which has no walls to keep the camera in, ignore movement
+				camera->location = old_location;
+			}
+		}
+	}
+
+	// Movement is split between the x and y directions so that the player doesnt get snagged on walls	
+	float angle = -camera->angle;
+	camera->location.x += translation.x * cos(angle) - translation.y * sin(angle);
+	
+	check_collide();
+	old_location = camera->location;
+
+	camera->location.y += translation.x * sin(angle) + translation.y * cos(angle);
+	
+	check_collide();
+
+	// Update camera z to be 1 unit above the floor.
+	// A room that hasn't been streamed in yet has no floor, so the height is kept until it is.
+	if (map->rooms[camera->room_idx] != &map_missing_room) camera->z = map->rooms[camera->room_idx]->z0 + 1;
+}
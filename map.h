@@ -5,7 +5,10 @@
 // |/___x
 //
 
+#pragma once
+
 #include <stdio.h>
+#include <stdint.h>
 #include "math.h"
 
 // Each room conisists of a serize of walls, defined by a sererse of vertesez, located in 2d space, wich may be a portal connecting to other rooms
@@ -22,16 +25,101 @@ struct WallVertex {
 // This sould be heep allocated
 // The wall vertecis must have a given order, so that from inside the room, the x cordinates are in acending order
 struct Room {
+	// Texture indexes for the floor and ceiling, or -1 for a flat color
 	int floor_texture;
+	int ceiling_texture;
+	// How bright the room is, from 0 for pitch black to 255 for fully lit
+	int light;
 	int length;
 	float z0;
 	float z1;
 	struct WallVertex walls[];
 };
 
+// A billboard sprite, drawn as a flat image always facing the camera
+struct Entity {
+	Point2 location;
+	// Height of the bottom of the sprite, and its size
+	float z, width, height;
+	// Texture index, or -1 to draw it white
+	int texture;
+};
+
+// The entities standing in one room.
+// Entities are kept with the room they are in, so the renderer only has to look at the entities in rooms it draws.
+struct RoomEntities {
+	struct Entity* entities;
+	int length, capacity;
+};
+
+// A room's potentially visible set, the set of rooms that can be seen from anywhere inside of it.
+// It is a bitset, but only covering the range of room indexes that are visible, to keep it small.
+struct PVSRoom {
+	// Index in pvs_bits of the first word of the set
+	uint64_t offset;
+	// The set covers rooms first_word * 64 up to (first_word + words) * 64
+	uint32_t first_word;
+	// PVS_ALL if the set is unknown, so every room must be assumed to be visible
+	uint32_t words;
+};
+
+#define PVS_ALL UINT32_MAX
+
+// Every wall in the map, packed into arrays of their own along with what can be worked out ahead of time, so the renderer never reads the rooms while drawing walls.
+// Each room has a slot, room i's walls are slot_start[i] to slot_start[i] + its length, with space up to slot_start[i+1] for it to grow into.
+// Slots stay where they are when rooms change, or are streamed in and out, unless a room outgrows its slot, then they are all laid out again.
+struct MapWalls {
+	int* slot_start;
+	// Position of the vertex each wall starts at
+	float* x;
+	float* y;
+	// Colors are RGBA8888, texture is -1 for none, and portal is the room behind the wall or -1
+	uint32_t* color;
+	int16_t* texture;
+	int32_t* portal;
+	// Length of the wall, and for portals, how far the next room's floor is above this one's and its ceiling below
+	float* length;
+	float* step_bottom;
+	float* step_top;
+	// The map revision the slots were last laid out in, anything keeping arrays the size of the slots has to remake them when it changes
+	uint64_t revision;
+	// Whether each room's slot has been filled in yet, rooms are only packed when they're first drawn, see map_pack_walls
+	unsigned char* packed;
+};
+
+struct MapGrid;
+struct TextureAtlas;
+
 struct Map {
 	Point2 starting_location;
 	int starting_room;
+	// The potentially visible set for each room, or NULL if it hasn't been computed, see pvs.h
+	struct PVSRoom* pvs;
+	uint64_t* pvs_bits;
+	size_t pvs_bits_length;
+	// Spatial index of the walls and rooms, built when first needed, see grid.h
+	struct MapGrid* grid;
+	// A box known to hold every room. Binary map files have it, so for a streamed map it includes rooms that aren't loaded yet.
+	// It is empty, with low above high, for maps loaded from text, the grid finds the bounds of the rooms itself.
+	Point2 bounds_low, bounds_high;
+	// The walls of every room, packed for the renderer, laid out by map_changed and filled in as rooms are drawn
+	struct MapWalls walls;
+	// Image files for each texture index, listed with TEXTURE in the map file
+	char** texture_paths;
+	int texture_count;
+	// The textures themselfs, NULL until loaded with load_map_textures, see texture.h
+	struct TextureAtlas* textures;
+	// Incremented every time the map changes, so renderers can tell when a frame needs to be redrawn
+	uint64_t revision;
+	// The revision each room last changed in
+	uint64_t* room_revision;
+	// The last revision that changed the whole map, or moved walls
+	uint64_t layout_revision;
+	// The entities in each room, listed with ENTITY in the map file
+	struct RoomEntities* entities;
+	// If the map was loaded from a binary map file, the rooms point into this mapping of the file.
+	void* mapping;
+	size_t mapping_size;
 	int length;
 	struct Room* rooms[];
 };
@@ -47,21 +135,98 @@ struct Camera {
 
 
 
+// Rooms of a streamed map that aren't loaded point to this, it has no walls, see stream.h
+extern struct Room map_missing_room;
+
 // Allocated a room with space for a certan amount of walls
 struct Room* allocate_room(int length);
 
 struct Map* allocate_map(int lenth);
 
+// Call after changing anything that affects the whole map, like its textures, this lays out the packed walls again.
+// Maps built by hand rather than loaded must call this once all the rooms are in, before they are drawn.
+void map_changed(struct Map* map);
+
+// Fill in a room's packed walls if they haven't been yet, the renderer does this the first time it draws a room.
+// This is safe to call from several threads drawing the map at once, the first one packs the room and the others wait for it.
+void map_pack_walls(struct Map* map, int roomid);
+
+// Call after changing a room, so frames showing it are redrawn, and its packed walls are updated.
+// Set moved if any walls were moved, which puts the room in the spatial index again, and redraws every frame, since the room may cover new parts of the screen.
+// Changing the floor or ceiling height counts as moving, rooms with portals into it have the steps up to it packed again.
+// The PVS is not rebuilt, so walls must not be moved in a way that lets rooms see new rooms.
+void map_room_changed(struct Map* map, int roomid, int moved);
+
+// Call after putting a diffrent room in at roomid, or putting map_missing_room back, like streaming does.
+// The room's old portals are found from its packed walls, so pack a room with map_pack_walls before taking it out, or the rooms next to it keep their steps up to it.
+// This updates the packed walls and spatial index like map_room_changed with moved set,
+// but only redraws where the room, or rooms with steps up to it, were drawn, since a room that wasn't there could only be seen through their portals.
+void map_room_replaced(struct Map* map, int roomid);
+
+// Add an entity to a room, returns its index in the room.
+int map_add_entity(struct Map* map, int roomid, struct Entity entity);
+
+// Remove an entity from a room, the last entity in the room is moved into its index.
+void map_remove_entity(struct Map* map, int roomid, int index);
+
+// Move an entity to a new location, and into the room it ends up in. roomid and index are updated to where the entity is kept now.
+// If the location isn't in any room, the entity stays in the room it was in.
+void map_move_entity(struct Map* map, int* roomid, int* index, Point2 location);
+
 // Allocate a test map
 struct Map* new_test_map();
 
 struct Map* load_map_from_file(FILE* file);
 
+// Write a map in the binary map format, returns 0 on success.
+// The binary format is the in memory layout of the rooms, with a header and a table of room offsets.
+int save_map_binary(struct Map* map, FILE* file);
+
+// Load a binary map file by maping it into memory, the rooms are used in place without being copied or parsed.
+// Returns NULL if the file is not a valid binary map.
+struct Map* load_map_binary(const char* path);
+
+// Load a map file in either the text or binary format.
+struct Map* load_map(const char* path);
+
+// Where the rooms are in a binary map file, for loading them one at a time
+struct MapIndex {
+	int fd;
+	uint64_t* offsets;
+	uint64_t file_size;
+};
+
+// Load everything in a binary map file but the rooms, which are all left as map_missing_room, and fill in index to load them with.
+// The file's checksum isn't checked, since that needs every room, each room is checked as it is loaded instead.
+// Returns NULL if the file is not a valid binary map.
+struct Map* load_map_index(const char* path, struct MapIndex* index);
+
+// Read one room from a binary map file, allocated like allocate_room. Returns NULL if it can't be read or isn't valid.
+// This only reads the file, so it can be called from any thread.
+struct Room* load_map_room(struct MapIndex* index, int roomid, int room_count);
+
+// Close the file, and free the index, the map is freed with free_map as usual
+void free_map_index(struct MapIndex* index);
+
+// Size of a room in memory, walls included
+size_t room_size(struct Room* room);
+
 void free_room(struct Room*);
 
 void free_map(struct Map*);
 
+// Free the map's PVS, if it has one
+void free_pvs(struct Map*);
+
 // Finds where a line segment from p0 to p1 intersects with the room geometry
 // Returns the wall it intersects with if it does, -1 otherwise
 // Optionaly, writes the point to point_of_collision if not NULL.
 int room_collide(struct Room*, Point2 p0, Point2 p1, Point2* point_of_collision);
+
+// Put the camera at a location, finding the room it is in.
+// If the location isn't in any room, the camera is put in fallback_room.
+void place_camera(struct Map* map, struct Camera* camera, Point2 location, int fallback_room);
+
+// Move the camera by translation (in camera space, so +y is forward), colliding with walls and moving trough portals.
+// Also updates the camera height to match the floor of the room it ends up in.
+void move_camera(struct Map* map, struct Camera* camera, Point2 translation);
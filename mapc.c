@@ -0,0 +1,54 @@
+// Map compiler
+// Converts a text map file into the binary map format, wich loads without any parsing.
+// The potentially visible sets are computed here too, so it doesn't need to be done on load.
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "map.h"
+#include "pvs.h"
+
+int main(int argc, char** argv) {
+	// Building the PVS can take a long time for huge maps that can see very far, so it can be skipped
+	int pvs = 1;
+	if (argc == 4 && !strcmp(argv[1], "--no-pvs")) {
+		pvs = 0;
+		argv++;
+		argc--;
+	}
+	if (argc != 3) {
+		printf("Usage: %s [--no-pvs] [input mapfile] [output binary mapfile]\n", argv[0]);
+		return 1;
+	}
+
+	FILE* input = fopen(argv[1], "r");
+	if (!input) {
+		printf("Failed to open %s\n", argv[1]);
+		return 1;
+	}
+	struct Map* map = load_map_from_file(input);
+	fclose(input);
+	if (!map) return 1;
+
+	if (pvs) build_pvs(map, sysconf(_SC_NPROCESSORS_ONLN));
+
+	FILE* output = fopen(argv[2], "wb");
+	if (!output) {
+		printf("Failed to open %s\n", argv[2]);
+		return 1;
+	}
+	if (save_map_binary(map, output) || fclose(output)) {
+		printf("Failed to write %s\n", argv[2]);
+		return 1;
+	}
+
+	printf("Compiled %d rooms\n", map->length);
+	if (map->pvs) {
+		int unknown = 0;
+		for (int i = 0; i < map->length; i++) unknown += map->pvs[i].words == PVS_ALL;
+		printf("PVS is %zu bytes, %d rooms can see too much to have one\n", sizeof(uint64_t) * map->pvs_bits_length + sizeof(struct PVSRoom) * map->length, unknown);
+	} else if (pvs) {
+		printf("No PVS, every room can see too much to have one\n");
+	}
+	return 0;
+}
@@ -0,0 +1,136 @@
+// Stress map generator
+// Writes text map files for the worst cases of the renderer and loader, with a size that can be turned up to see how they scale.
+// The maps are plain .map files, so they can be loaded directly or compiled with mapc like any other.
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define PI 3.14159265358979323846
+
+// Radius of a ring of sides points, far enough apart that each side is 2 units long
+double ring_radius(int sides) {
+	return 1 / sin(PI / sides);
+}
+
+// Shapes of map, see the usage text in main
+void grid(FILE* out, int w, int h) {
+	// Square rooms in a grid, with a portal to every neighbour, and floors at a few diffrent heights so there are steps
+	float size = 4;
+	fprintf(out, "# %dx%d grid of rooms\n", w, h);
+	// Start in the middle, so the camera looks across the grid rather than into a corner
+	fprintf(out, "MAP %d %d %g %g\n", w * h, w / 2 + h / 2 * w, (w / 2 + 0.5f) * size, (h / 2 + 0.5f) * size);
+	for (int y = 0; y < h; y++) {
+		for (int x = 0; x < w; x++) {
+			float x0 = x * size, y0 = y * size, x1 = x0 + size, y1 = y0 + size;
+			float z0 = -1 + ((x * 7 + y * 3) % 4) * 0.1f;
+			int room = x + y * w;
+			fprintf(out, "ROOM 4 %g 1 -1 -1 %d\n", z0, 160 + (x * 13 + y * 29) % 96);
+			// Walls go clockwise, each vertex starts the wall to the next one
+			if (x > 0) fprintf(out, "PORTAL %g %g %d\n", x0, y0, room - 1);
+			else fprintf(out, "WALL %g %g 200 40 40\n", x0, y0);
+			if (y + 1 < h) fprintf(out, "PORTAL %g %g %d\n", x0, y1, room + w);
+			else fprintf(out, "WALL %g %g 40 200 40\n", x0, y1);
+			if (x + 1 < w) fprintf(out, "PORTAL %g %g %d\n", x1, y1, room + 1);
+			else fprintf(out, "WALL %g %g 40 40 200\n", x1, y1);
+			if (y > 0) fprintf(out, "PORTAL %g %g %d\n", x1, y0, room - w);
+			else fprintf(out, "WALL %g %g 200 200 40\n", x1, y0);
+		}
+	}
+}
+
+void corridor(FILE* out, int length) {
+	// A straight line of rooms, so every portal down the corridor is in view at once
+	fprintf(out, "# Corridor of %d rooms\n", length);
+	fprintf(out, "MAP %d 0 1 0.5\n", length);
+	for (int i = 0; i < length; i++) {
+		float y0 = i * 3, y1 = y0 + 3;
+		fprintf(out, "ROOM 4 -1 %g\n", 1 + (i % 2) * 0.5f);
+		fprintf(out, "WALL 0 %g %d 80 80\n", y0, 80 + (i * 37) % 176);
+		if (i + 1 < length) fprintf(out, "PORTAL 0 %g %d\n", y1, i + 1);
+		else fprintf(out, "WALL 0 %g 200 200 200\n", y1);
+		fprintf(out, "WALL 2 %g 80 %d 80\n", y1, 80 + (i * 53) % 176);
+		if (i > 0) fprintf(out, "PORTAL 2 %g %d\n", y0, i - 1);
+		else fprintf(out, "WALL 2 %g 200 200 200\n", y0);
+	}
+}
+
+void round_room(FILE* out, int walls) {
+	// One round room with a lot of walls, to stress walking the walls of a room
+	double radius = ring_radius(walls);
+	fprintf(out, "# One room with %d walls\n", walls);
+	fprintf(out, "MAP 1 0 0 0\n");
+	fprintf(out, "ROOM %d -1 1\n", walls);
+	for (int i = 0; i < walls; i++) {
+		double angle = -2 * PI * i / walls;
+		fprintf(out, "WALL %g %g %d %d 128\n", radius * cos(angle), radius * sin(angle), (i * 255) / walls, 255 - (i * 255) / walls);
+	}
+}
+
+void hub(FILE* out, int portals) {
+	// A round room with a portal in every wall, each leading to a small room, so one room has a lot of portals in view
+	double radius = ring_radius(portals);
+	fprintf(out, "# Hub with %d portals\n", portals);
+	fprintf(out, "MAP %d 0 0 0\n", portals + 1);
+	fprintf(out, "ROOM %d -1 1\n", portals);
+	for (int i = 0; i < portals; i++) {
+		double angle = -2 * PI * i / portals;
+		fprintf(out, "PORTAL %g %g %d\n", radius * cos(angle), radius * sin(angle), i + 1);
+	}
+	// The room behind each wall goes back along it, and out away from the hub
+	for (int i = 0; i < portals; i++) {
+		double a = -2 * PI * i / portals, b = -2 * PI * (i + 1) / portals;
+		fprintf(out, "ROOM 4 %g 1\n", -1 + (i % 3) * 0.2f);
+		fprintf(out, "PORTAL %g %g 0\n", radius * cos(b), radius * sin(b));
+		fprintf(out, "WALL %g %g 128 %d 200\n", radius * cos(a), radius * sin(a), (i * 255) / portals);
+		fprintf(out, "WALL %g %g 128 128 128\n", radius * 1.5 * cos(a), radius * 1.5 * sin(a));
+		fprintf(out, "WALL %g %g 128 %d 200\n", radius * 1.5 * cos(b), radius * 1.5 * sin(b), (i * 255) / portals);
+	}
+}
+
+int main(int argc, char** argv) {
+	if (argc < 4) {
+		printf("Usage: %s [shape] [size] [output mapfile]\n", argv[0]);
+		printf("Shapes:\n");
+		printf("  grid      size by size rooms, each with a portal to every neighbour, or w by h rooms for a size of wxh\n");
+		printf("  corridor  size rooms in a straight line\n");
+		printf("  room      one room with size walls\n");
+		printf("  hub       one room with size portals to small rooms around it\n");
+		return 1;
+	}
+	// Grids can have a second size, as wxh
+	char* end;
+	int size = strtol(argv[2], &end, 10), height = size;
+	if (*end == 'x' && !strcmp(argv[1], "grid")) {
+		char* start = end + 1;
+		height = strtol(start, &end, 10);
+		if (end == start) end = start - 1;
+	}
+	if (end == argv[2] || *end) {
+		printf("Bad size %s\n", argv[2]);
+		return 1;
+	}
+	if (size < 1 || height < 1 || ((!strcmp(argv[1], "room") || !strcmp(argv[1], "hub")) && size < 3)) {
+		printf("Size is too small\n");
+		return 1;
+	}
+	FILE* out = fopen(argv[3], "w");
+	if (!out) {
+		printf("Failed to open %s\n", argv[3]);
+		return 1;
+	}
+
+	if (!strcmp(argv[1], "grid")) grid(out, size, height);
+	else if (!strcmp(argv[1], "corridor")) corridor(out, size);
+	else if (!strcmp(argv[1], "room")) round_room(out, size);
+	else if (!strcmp(argv[1], "hub")) hub(out, size);
+	else {
+		printf("Unknown shape %s\n", argv[1]);
+		fclose(out);
+		remove(argv[3]);
+		return 1;
+	}
+	fclose(out);
+	return 0;
+}
@@ -1,4 +1,5 @@
 // Basic math functions
+#pragma once
 
 typedef struct Point2 {
 	float x;
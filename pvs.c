@@ -0,0 +1,375 @@
+// Potentially visible sets, see pvs.h
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include "pvs.h"
+
+// Most portal steps to take from a single room, if there are more the room gets no PVS (everything is visible).
+// This keeps long straight corridors, that can see a huge number of rooms, from taking forever.
+#define PVS_MAX_STEPS 16384
+
+// Most portal steps to take over the whole map, split evenly between the rooms.
+// On maps with so many rooms that each can't have PVS_MAX_STEPS, rooms give up sooner, so the build takes seconds rather than minutes.
+#define PVS_MAX_BUILD_STEPS (1 << 26)
+
+// How many times the part of a portal looked trough can grow, before the whole portal is used.
+#define PVS_MAX_GROWS 8
+
+// How close to a line a point must be to count as being on it, points on the line are never clipped.
+#define PVS_EPSILON 0.0001
+
+// Which side of the line from l0 to l1 a point is on, positive is left.
+float line_side(Point2 l0, Point2 l1, Point2 p) {
+	return (l1.x - l0.x) * (p.y - l0.y) - (l1.y - l0.y) * (p.x - l0.x);
+}
+
+// Clip the segment from p0 to p1 to the side of the line l0 to l1 that the point keep is on.
+// Returns 0 if nothing is left.
+// If keep is on the line there is no clear side, so nothing is clipped, it is better to see too much than too little.
+int clip_to_side(Point2* p0, Point2* p1, Point2 l0, Point2 l1, Point2 keep) {
+	float side = line_side(l0, l1, keep);
+	if (fabsf(side) < PVS_EPSILON) return 1;
+	float d0 = line_side(l0, l1, *p0) * (side > 0 ? 1 : -1);
+	float d1 = line_side(l0, l1, *p1) * (side > 0 ? 1 : -1);
+
+	if (d0 < -PVS_EPSILON && d1 < -PVS_EPSILON) return 0;
+	if (d0 < -PVS_EPSILON) *p0 = intersect_lines(l0, l1, *p0, *p1);
+	if (d1 < -PVS_EPSILON) *p1 = intersect_lines(l0, l1, *p0, *p1);
+	return !isnan(p0->x) && !isnan(p1->x);
+}
+
+// Point past a segment from a point, used to pick the far side of a line
+Point2 reflect(Point2 point, Point2 l0, Point2 l1) {
+	Point2 middle = {(l0.x + l1.x) / 2, (l0.y + l1.y) / 2};
+	return (Point2) {2 * middle.x - point.x, 2 * middle.y - point.y};
+}
+
+// Clip a portal p0 to p1 to the part that can be seen from source portal s0 to s1 trough window w0 to w1.
+// Everything that can be seen trough both is on the far side of the window from the point behind,
+// and between the separating lines, the lines trough an endpoint of each portal that have the source and window on opposite sides.
+int clip_to_view(Point2* p0, Point2* p1, Point2 s0, Point2 s1, Point2 w0, Point2 w1, Point2 behind) {
+	if (!clip_to_side(p0, p1, w0, w1, reflect(behind, w0, w1))) return 0;
+
+	Point2 source[2] = {s0, s1};
+	Point2 window[2] = {w0, w1};
+	for (int i = 0; i < 2; i++) {
+		for (int j = 0; j < 2; j++) {
+			Point2 s = source[i], s_other = source[!i];
+			Point2 w = window[j], w_other = window[!j];
+			// Portals that share a corner don't have a separating line trough it
+			if (fabsf(s.x - w.x) < PVS_EPSILON && fabsf(s.y - w.y) < PVS_EPSILON) continue;
+			// Only lines with the other endpoints on opposite sides bound the view
+			if (line_side(s, w, s_other) * line_side(s, w, w_other) >= 0) continue;
+			if (!clip_to_side(p0, p1, s, w, w_other)) return 0;
+		}
+	}
+	return 1;
+}
+
+// State for finding the PVS of one room, each thread has its own.
+typedef struct PVSSearch {
+	struct Map* map;
+	// Rooms found to be visible, and a flag for each room to avoid duplicates
+	int* visible;
+	int visible_length;
+	char* is_visible;
+	// Rooms in the current chain of portals, so cycles are not followed
+	char* in_path;
+	// Steps taken from the current room, and the most it can take
+	int steps, max_steps;
+	// Size of the group of rooms connected to each room by portals, nothing outside of it can be seen.
+	// Once all of them are visible there's nothing left to find, so the search stops there.
+	int* group_size;
+	int reachable;
+
+	// Index of the first wall of each room, to give every wall in the map an index
+	int* wall_start;
+	// The part of each portal that has been looked trough from the current source portal, from 0 (the wall's start) to 1 (its end).
+	// Only valid if window_source matches source.
+	float* window_min;
+	float* window_max;
+	unsigned* window_source;
+	unsigned char* window_grows;
+	unsigned source;
+} PVSSearch;
+
+void mark_visible(PVSSearch* search, int room) {
+	if (search->is_visible[room]) return;
+	search->is_visible[room] = 1;
+	search->visible[search->visible_length++] = room;
+}
+
+Point2 wall_end(struct Room* room, int wall) {
+	return room->walls[wall + 1 < room->length ? wall + 1 : 0].location;
+}
+
+// Center of a room, a point that is inside of it since rooms are convex
+Point2 room_center(struct Room* room) {
+	Point2 center = {0, 0};
+	for (int i = 0; i < room->length; i++) {
+		center.x += room->walls[i].location.x / room->length;
+		center.y += room->walls[i].location.y / room->length;
+	}
+	return center;
+}
+
+// How far along the segment from a to b the point p is, 0 is at a and 1 is at b.
+float segment_position(Point2 a, Point2 b, Point2 p) {
+	float length_squared = (b.x - a.x) * (b.x - a.x) + (b.y - a.y) * (b.y - a.y);
+	return ((p.x - a.x) * (b.x - a.x) + (p.y - a.y) * (b.y - a.y)) / length_squared;
+}
+
+// Check if the visible part of a portal has already been looked trough from the current source portal.
+// If not, it is merged with what was looked trough before, and the portal needs to be followed again with the merged part.
+// A portal reached by many paths will only be followed a few times, instead of once per path.
+// Returns 0 if the portal doesn't need to be followed again.
+int widen_window(PVSSearch* search, int roomid, int wall, Point2* p0, Point2* p1) {
+	struct Room* room = search->map->rooms[roomid];
+	int index = search->wall_start[roomid] + wall;
+	Point2 a = room->walls[wall].location;
+	Point2 b = wall_end(room, wall);
+	float t0 = segment_position(a, b, *p0);
+	float t1 = segment_position(a, b, *p1);
+	float low = MIN(t0, t1), high = MAX(t0, t1);
+
+	if (search->window_source[index] == search->source) {
+		if (low >= search->window_min[index] - PVS_EPSILON && high <= search->window_max[index] + PVS_EPSILON) return 0;
+		low = MIN(low, search->window_min[index]);
+		high = MAX(high, search->window_max[index]);
+		// Stop making tiny steps, and just use the whole portal
+		if (++search->window_grows[index] > PVS_MAX_GROWS) {
+			low = 0;
+			high = 1;
+		}
+	} else {
+		search->window_source[index] = search->source;
+		search->window_grows[index] = 0;
+	}
+	search->window_min[index] = low;
+	search->window_max[index] = high;
+
+	*p0 = (Point2) {a.x + (b.x - a.x) * low, a.y + (b.y - a.y) * low};
+	*p1 = (Point2) {a.x + (b.x - a.x) * high, a.y + (b.y - a.y) * high};
+	return 1;
+}
+
+// Follow every portal out of roomid that can be seen from the source portal trough the window.
+// Returns 0 if the search ran out of steps, or every room it could reach is visible.
+int pvs_flow(PVSSearch* search, int roomid, Point2 s0, Point2 s1, Point2 w0, Point2 w1, Point2 behind) {
+	struct Room* room = search->map->rooms[roomid];
+	Point2 source_middle = {(s0.x + s1.x) / 2, (s0.y + s1.y) / 2};
+	int ok = 1;
+	search->in_path[roomid] = 1;
+	for (int wall = 0; wall < room->length && ok; wall++) {
+		int portal = room->walls[wall].portal_idx;
+		if (portal == -1 || search->in_path[portal]) continue;
+		if (++search->steps > search->max_steps || search->visible_length == search->reachable) {
+			ok = 0;
+			break;
+		}
+
+		Point2 p0 = room->walls[wall].location;
+		Point2 p1 = wall_end(room, wall);
+		if (!clip_to_view(&p0, &p1, s0, s1, w0, w1, behind)) continue;
+		mark_visible(search, portal);
+		if (!widen_window(search, roomid, wall, &p0, &p1)) continue;
+
+		ok = pvs_flow(search, portal, s0, s1, p0, p1, source_middle);
+	}
+	search->in_path[roomid] = 0;
+	return ok;
+}
+
+// Find every room visible from roomid.
+// Returns 0 if there were too many to follow, or every room connected to it can be seen, since then a PVS wouldn't rule anything out.
+int find_pvs(PVSSearch* search, int roomid) {
+	struct Map* map = search->map;
+	for (int i = 0; i < search->visible_length; i++) search->is_visible[search->visible[i]] = 0;
+	search->visible_length = 0;
+	search->steps = 0;
+	search->reachable = search->group_size[roomid];
+
+	struct Room* room = map->rooms[roomid];
+	Point2 center = room_center(room);
+	mark_visible(search, roomid);
+
+	// Every room next to this one can be seen, and everything that can be seen trough the portal into it.
+	// For the first step, the portal is both the source and the window.
+	int ok = 1;
+	search->in_path[roomid] = 1;
+	for (int wall = 0; wall < room->length && ok; wall++) {
+		int next = room->walls[wall].portal_idx;
+		if (next == -1 || next == roomid) continue;
+		mark_visible(search, next);
+
+		Point2 s0 = room->walls[wall].location;
+		Point2 s1 = wall_end(room, wall);
+		search->source++;
+		ok = pvs_flow(search, next, s0, s1, s0, s1, center);
+	}
+	search->in_path[roomid] = 0;
+	return ok && search->visible_length < search->reachable;
+}
+
+// Work shared between the threads building the PVS
+typedef struct PVSBuild {
+	struct Map* map;
+	pthread_mutex_t lock;
+	int next_room;
+	// Index of the first wall of each room, and the total number of walls
+	int* wall_start;
+	int walls;
+	// Steps each room can take, and the size of each room's group, see PVSSearch
+	int max_steps;
+	int* group_size;
+	// The visible rooms found for each room, as a bitset range, before they are packed together
+	uint64_t** sets;
+	struct PVSRoom* ranges;
+} PVSBuild;
+
+// Turn the visible rooms found by a search into a bitset covering just the visible range
+void store_pvs(PVSBuild* build, PVSSearch* search, int roomid, int ok) {
+	struct PVSRoom* range = &build->ranges[roomid];
+	if (!ok) {
+		range->first_word = 0;
+		range->words = PVS_ALL;
+		build->sets[roomid] = NULL;
+		return;
+	}
+
+	int lowest = roomid, highest = roomid;
+	for (int i = 0; i < search->visible_length; i++) {
+		lowest = MIN(lowest, search->visible[i]);
+		highest = MAX(highest, search->visible[i]);
+	}
+	range->first_word = lowest / 64;
+	range->words = highest / 64 - lowest / 64 + 1;
+	uint64_t* set = calloc(range->words, sizeof(uint64_t));
+	for (int i = 0; i < search->visible_length; i++) {
+		int room = search->visible[i];
+		set[room / 64 - range->first_word] |= (uint64_t)1 << (room % 64);
+	}
+	build->sets[roomid] = set;
+}
+
+void* pvs_worker(void* data) {
+	PVSBuild* build = data;
+	int length = build->map->length;
+	PVSSearch search = {
+		.map = build->map,
+		.visible = malloc(sizeof(int) * length),
+		.visible_length = 0,
+		.is_visible = calloc(length, 1),
+		.in_path = calloc(length, 1),
+		.max_steps = build->max_steps,
+		.group_size = build->group_size,
+		.wall_start = build->wall_start,
+		.window_min = malloc(sizeof(float) * build->walls),
+		.window_max = malloc(sizeof(float) * build->walls),
+		.window_source = calloc(build->walls, sizeof(unsigned)),
+		.window_grows = malloc(build->walls),
+		.source = 0,
+	};
+
+	while (1) {
+		pthread_mutex_lock(&build->lock);
+		int roomid = build->next_room++;
+		pthread_mutex_unlock(&build->lock);
+		if (roomid >= length) break;
+
+		int ok = find_pvs(&search, roomid);
+		store_pvs(build, &search, roomid, ok);
+	}
+
+	free(search.visible);
+	free(search.is_visible);
+	free(search.in_path);
+	free(search.window_min);
+	free(search.window_max);
+	free(search.window_source);
+	free(search.window_grows);
+	return NULL;
+}
+
+int group_root(int* parent, int room) {
+	while (parent[room] != room) room = parent[room] = parent[parent[room]];
+	return room;
+}
+
+// Find how many rooms are in each room's group of rooms connected by portals
+int* group_sizes(struct Map* map) {
+	int* parent = malloc(sizeof(int) * map->length);
+	int* size = calloc(map->length, sizeof(int));
+	for (int i = 0; i < map->length; i++) parent[i] = i;
+	for (int i = 0; i < map->length; i++) {
+		struct Room* room = map->rooms[i];
+		for (int wall = 0; wall < room->length; wall++) {
+			int portal = room->walls[wall].portal_idx;
+			if (portal != -1) parent[group_root(parent, i)] = group_root(parent, portal);
+		}
+	}
+	for (int i = 0; i < map->length; i++) size[group_root(parent, i)]++;
+	int* group_size = malloc(sizeof(int) * map->length);
+	for (int i = 0; i < map->length; i++) group_size[i] = size[group_root(parent, i)];
+	free(parent);
+	free(size);
+	return group_size;
+}
+
+void build_pvs(struct Map* map, int threads) {
+	if (threads < 1) threads = 1;
+	PVSBuild build = {
+		.map = map,
+		.next_room = 0,
+		.sets = malloc(sizeof(uint64_t*) * map->length),
+		.ranges = malloc(sizeof(struct PVSRoom) * map->length),
+		.wall_start = malloc(sizeof(int) * map->length),
+		.walls = 0,
+		.max_steps = MIN(PVS_MAX_STEPS, PVS_MAX_BUILD_STEPS / MAX(map->length, 1)),
+		.group_size = group_sizes(map),
+	};
+	pthread_mutex_init(&build.lock, NULL);
+	for (int i = 0; i < map->length; i++) {
+		build.wall_start[i] = build.walls;
+		build.walls += map->rooms[i]->length;
+	}
+
+	pthread_t workers[threads];
+	for (int i = 1; i < threads; i++) pthread_create(&workers[i], NULL, pvs_worker, &build);
+	pvs_worker(&build);
+	for (int i = 1; i < threads; i++) pthread_join(workers[i], NULL);
+	pthread_mutex_destroy(&build.lock);
+
+	free(build.group_size);
+	free_pvs(map);
+
+	// Pack every room's bitset into one array
+	size_t total = 0;
+	int known = 0;
+	for (int i = 0; i < map->length; i++) {
+		build.ranges[i].offset = total;
+		if (build.ranges[i].words == PVS_ALL) continue;
+		total += build.ranges[i].words;
+		known++;
+	}
+	// If no room has a set, the PVS wouldn't rule anything out, so the map is left without one
+	if (!known) {
+		free(build.sets);
+		free(build.ranges);
+		free(build.wall_start);
+		return;
+	}
+	uint64_t* bits = malloc(sizeof(uint64_t) * (total ? total : 1));
+	for (int i = 0; i < map->length; i++) {
+		if (build.ranges[i].words == PVS_ALL) continue;
+		memcpy(&bits[build.ranges[i].offset], build.sets[i], sizeof(uint64_t) * build.ranges[i].words);
+		free(build.sets[i]);
+	}
+	free(build.sets);
+	free(build.wall_start);
+
+	map->pvs = build.ranges;
+	map->pvs_bits = bits;
+	map->pvs_bits_length = total;
+}
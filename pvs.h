@@ -0,0 +1,20 @@
+// Potentially visible sets
+// For every room, the set of rooms that could ever be seen from inside it, found by following portals.
+// The renderer uses this to skip portals into rooms that can't be visible, without projecting them.
+#pragma once
+
+#include "map.h"
+
+// Compute the PVS for every room in the map, using threads threads.
+// Replaces any existing PVS. If no room gets a set, because they can all see everything they're connected to or too much to search, the map is left with none.
+void build_pvs(struct Map* map, int threads);
+
+// Check if room to could be visible from room from
+static inline int pvs_visible(struct Map* map, int from, int to) {
+	if (!map->pvs) return 1;
+	struct PVSRoom* set = &map->pvs[from];
+	if (set->words == PVS_ALL) return 1;
+	uint32_t word = (uint32_t)to / 64 - set->first_word;
+	if (word >= set->words) return 0;
+	return map->pvs_bits[set->offset + word] >> (to % 64) & 1;
+}
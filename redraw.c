@@ -0,0 +1,96 @@
+// Change tracking, see redraw.h
+#include <stdlib.h>
+#include "redraw.h"
+
+struct Redraw {
+	// Set once a frame has been drawn
+	int valid;
+	// What the canvas was drawn with
+	struct Camera camera;
+	struct Map* map;
+	uint64_t revision;
+	int w, h;
+	// The columns each room on the canvas was drawn in
+	struct RoomVisit* visits;
+	int visit_count, visit_capacity;
+};
+
+Redraw* redraw_create() {
+	return calloc(1, sizeof(Redraw));
+}
+
+void redraw_free(Redraw* redraw) {
+	free(redraw->visits);
+	free(redraw);
+}
+
+void redraw_invalidate(Redraw* redraw) {
+	redraw->valid = 0;
+}
+
+// Check if a camera would see anything diffrent, the cached sin and cos are ignored since they follow the angle.
+int camera_moved(struct Camera* a, struct Camera* b) {
+	return a->location.x != b->location.x || a->location.y != b->location.y || a->room_idx != b->room_idx || a->z != b->z || a->angle != b->angle;
+}
+
+int redraw_columns(Redraw* redraw, Canvas* canvas, struct Camera* camera, struct Map* map, int* x_min, int* x_max) {
+	// Anything that changes the view, or could move things on screen, needs the whole frame
+	if (
+		!redraw->valid || redraw->map != map || redraw->w != canvas->w || redraw->h != canvas->h ||
+		camera_moved(&redraw->camera, camera) || map->layout_revision > redraw->revision
+	) {
+		*x_min = 0;
+		*x_max = canvas->w;
+		return 1;
+	}
+	if (map->revision == redraw->revision) return 0;
+
+	// Otherwise only the columns where changed rooms were drawn
+	int low = canvas->w, high = 0;
+	for (int i = 0; i < redraw->visit_count; i++) {
+		struct RoomVisit* visit = &redraw->visits[i];
+		if (map->room_revision[visit->room] > redraw->revision) {
+			low = MIN(low, visit->x_min);
+			high = MAX(high, visit->x_max);
+		}
+	}
+	if (low >= high) {
+		// None of the changed rooms are on screen
+		redraw->revision = map->revision;
+		return 0;
+	}
+	*x_min = low;
+	*x_max = high;
+	return 1;
+}
+
+void redraw_record(
+	Redraw* redraw, RenderContext** contexts, int context_count,
+	Canvas* canvas, struct Camera* camera, struct Map* map, int x_min, int x_max
+) {
+	// Forget the rooms that were drawn over.
+	// Rooms only partly drawn over are kept, they might still be on screen outside of the new columns.
+	int kept = 0;
+	for (int i = 0; i < redraw->visit_count; i++) {
+		struct RoomVisit visit = redraw->visits[i];
+		if (visit.x_min < x_min || visit.x_max > x_max) redraw->visits[kept++] = visit;
+	}
+	redraw->visit_count = kept;
+
+	for (int i = 0; i < context_count; i++) {
+		int count;
+		struct RoomVisit* visits = render_context_visits(contexts[i], &count);
+		if (redraw->visit_count + count > redraw->visit_capacity) {
+			redraw->visit_capacity = MAX(redraw->visit_capacity * 2, redraw->visit_count + count);
+			redraw->visits = realloc(redraw->visits, sizeof(struct RoomVisit) * redraw->visit_capacity);
+		}
+		for (int j = 0; j < count; j++) redraw->visits[redraw->visit_count++] = visits[j];
+	}
+
+	redraw->valid = 1;
+	redraw->camera = *camera;
+	redraw->map = map;
+	redraw->revision = map->revision;
+	redraw->w = canvas->w;
+	redraw->h = canvas->h;
+}
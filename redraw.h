@@ -0,0 +1,25 @@
+// Change tracking, to avoid drawing frames that haven't changed
+// The camera and map revision the canvas was drawn with are remembered, along with the columns each room was drawn in.
+// If the camera hasn't moved, only the columns showing rooms that changed need to be drawn again, and if nothing changed, nothing does.
+#pragma once
+
+#include "render.h"
+
+typedef struct Redraw Redraw;
+
+Redraw* redraw_create();
+
+void redraw_free(Redraw* redraw);
+
+// Find what has to be drawn for the canvas to show the map from the camera.
+// Returns 0 if the canvas is already up to date, otherwise sets x_min and x_max to the columns that have to be drawn.
+int redraw_columns(Redraw* redraw, Canvas* canvas, struct Camera* camera, struct Map* map, int* x_min, int* x_max);
+
+// Remember what was drawn after drawing columns x_min to x_max, using the rooms visited by the render contexts that drew them.
+void redraw_record(
+	Redraw* redraw, RenderContext** contexts, int context_count,
+	Canvas* canvas, struct Camera* camera, struct Map* map, int x_min, int x_max
+);
+
+// Forget what the canvas shows, so the next frame is drawn in full. Use this if the canvas was changed some other way.
+void redraw_invalidate(Redraw* redraw);
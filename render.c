@@ -0,0 +1,986 @@
+// Software renderer, see render.h
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "render.h"
+#include "pvs.h"
+#include "texture.h"
+#include "arena.h"
+#include "light.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// The number type used for projection, clipping and interpolation is picked when building:
+//  - float by default
+//  - double with -DRENDER_DOUBLE
+//  - float, but stepping the edges of walls down each column in 16.16 fixed point, with -DRENDER_FIXED
+#ifdef RENDER_DOUBLE
+typedef double real;
+#else
+typedef float real;
+#endif
+
+// Values stepped across the columns of a wall
+#ifdef RENDER_FIXED
+// Walls close to the camera go far off screen, so this is 64 bits to leave room above the 16 fraction bits
+typedef int64_t Edge;
+#define EDGE(value) ((Edge)((value) * 65536))
+#define EDGE_VALUE(edge) ((real)(edge) * (real)(1.0 / 65536))
+#define EDGE_ROW(edge) ((int)MIN(MAX((edge) >> 16, -(1 << 30)), 1 << 30))
+#else
+typedef real Edge;
+#define EDGE(value) ((Edge)(value))
+#define EDGE_VALUE(edge) (edge)
+#define EDGE_ROW(edge) ((int)MIN(MAX((edge), -(1 << 30)), 1 << 30))
+#endif
+
+// A point in the renderer's number type, Point2 is only used for the map, which is always stored as float.
+typedef struct RenderPoint {
+	real x, y;
+} RenderPoint;
+
+// How far from the center of the viewing plain (1 unit away from camera) should the screen be?
+#define FOV .4
+
+const char* render_numeric() {
+#if defined(RENDER_FIXED)
+	return "fixed";
+#elif defined(RENDER_DOUBLE)
+	return "double";
+#else
+	return "float";
+#endif
+}
+
+/////////////////////////
+// Graphics Primitives //
+/////////////////////////
+
+Canvas* canvas_allocate(int w, int h) {
+	Canvas* canvas = malloc(sizeof(Canvas));
+	canvas->pixels = malloc(sizeof(uint32_t) * w * h);
+	canvas->w = w;
+	canvas->h = h;
+	return canvas;
+}
+
+void canvas_free(Canvas* canvas) {
+	free(canvas->pixels);
+	free(canvas);
+}
+
+void canvas_fill(Canvas* canvas, uint32_t color) {
+	for (int i = 0; i < canvas->w * canvas->h; i++) canvas->pixels[i] = color;
+}
+
+void vline(Canvas* canvas, int x, int y0, int y1, int r, int g, int b) {
+	uint32_t color = (uint32_t)r << 24 | g << 16 | b << 8 | 0xff;
+	uint32_t* column = canvas_column(canvas, x);
+	for (int y = y0; y < y1; y++) column[y] = color;
+}
+
+// Size of the tiles the canvas is transposed in, a tile of the canvas and the output should fit in L1 cache.
+#define TRANSPOSE_TILE 32
+
+// Transpose a block of pixels with plain C, used for the edges of the canvas.
+void transpose_block(Canvas* canvas, uint8_t* out, int pitch, int x0, int x1, int y0, int y1) {
+	for (int y = y0; y < y1; y++) {
+		uint32_t* row = (uint32_t*)(out + (size_t)y * pitch);
+		for (int x = x0; x < x1; x++) row[x] = canvas->pixels[y + x * canvas->h];
+	}
+}
+
+void canvas_transpose(Canvas* canvas, void* out, int pitch) {
+	int w = canvas->w, h = canvas->h;
+#ifdef __SSE2__
+	// Only the whole 4x4 blocks are done with SSE, the right and bottom edges are done after.
+	int w4 = w & ~3, h4 = h & ~3;
+	for (int tile_x = 0; tile_x < w4; tile_x += TRANSPOSE_TILE) {
+		for (int tile_y = 0; tile_y < h4; tile_y += TRANSPOSE_TILE) {
+			int x_end = MIN(tile_x + TRANSPOSE_TILE, w4);
+			int y_end = MIN(tile_y + TRANSPOSE_TILE, h4);
+			for (int x = tile_x; x < x_end; x += 4) {
+				for (int y = tile_y; y < y_end; y += 4) {
+					// Load 4 pixels from each of 4 columns
+					__m128i c0 = _mm_loadu_si128((__m128i*)&canvas->pixels[y + (x + 0) * h]);
+					__m128i c1 = _mm_loadu_si128((__m128i*)&canvas->pixels[y + (x + 1) * h]);
+					__m128i c2 = _mm_loadu_si128((__m128i*)&canvas->pixels[y + (x + 2) * h]);
+					__m128i c3 = _mm_loadu_si128((__m128i*)&canvas->pixels[y + (x + 3) * h]);
+
+					// 4x4 transpose
+					__m128i t0 = _mm_unpacklo_epi32(c0, c1);
+					__m128i t1 = _mm_unpacklo_epi32(c2, c3);
+					__m128i t2 = _mm_unpackhi_epi32(c0, c1);
+					__m128i t3 = _mm_unpackhi_epi32(c2, c3);
+					__m128i r0 = _mm_unpacklo_epi64(t0, t1);
+					__m128i r1 = _mm_unpackhi_epi64(t0, t1);
+					__m128i r2 = _mm_unpacklo_epi64(t2, t3);
+					__m128i r3 = _mm_unpackhi_epi64(t2, t3);
+
+					// Store them as 4 pixels in each of 4 rows
+					uint8_t* row = (uint8_t*)out + (size_t)y * pitch + x * sizeof(uint32_t);
+					_mm_storeu_si128((__m128i*)(row + 0 * pitch), r0);
+					_mm_storeu_si128((__m128i*)(row + 1 * pitch), r1);
+					_mm_storeu_si128((__m128i*)(row + 2 * pitch), r2);
+					_mm_storeu_si128((__m128i*)(row + 3 * pitch), r3);
+				}
+			}
+		}
+	}
+	transpose_block(canvas, out, pitch, w4, w, 0, h);
+	transpose_block(canvas, out, pitch, 0, w4, h4, h);
+#else
+	for (int tile_x = 0; tile_x < w; tile_x += TRANSPOSE_TILE)
+		for (int tile_y = 0; tile_y < h; tile_y += TRANSPOSE_TILE)
+			transpose_block(canvas, out, pitch, tile_x, MIN(tile_x + TRANSPOSE_TILE, w), tile_y, MIN(tile_y + TRANSPOSE_TILE, h));
+#endif
+}
+
+//////////////////////////////////////////////////
+// Cordinate space convertion                   //
+// This handles projection and camera positions //
+//////////////////////////////////////////////////
+
+// Rotate a direction in camera space to world space, this is the inverse of the rotation in transform_vertices.
+// Only directions are converted, not points, since adding the camera location would lose precision far from the origin.
+RenderPoint camera_to_world_direction(struct Camera* camera, RenderPoint c) {
+	return (RenderPoint) {
+		.x = c.x * camera->angle_cos + c.y * camera->angle_sin,
+		.y = -c.x * camera->angle_sin + c.y * camera->angle_cos
+	};
+}
+
+// Convert a Point in camera space to normalized screen space.
+RenderPoint camera_to_screen_space(RenderPoint cameraspace, real z, real fov) {
+	return (RenderPoint) {
+		.x = cameraspace.x / cameraspace.y / fov,
+		.y = z / cameraspace.y / fov,
+	};
+}
+
+// Scale and translate the screen cordinates to pixel cordinates for SDL.
+RenderPoint normalized_screen_to_pixel(RenderPoint world, real screenh, real screenw) {
+	return (RenderPoint) {
+		.x = (world.x + 1) * (screenw / 2),
+		.y = ((-world.y) + 1) * (screenh / 2),
+	};
+}
+
+// All in one function to go from camera space to pixels
+RenderPoint camera_to_pixel_space(RenderPoint camera, real z, real screenh, real screenw, real fov) {
+	return normalized_screen_to_pixel(camera_to_screen_space(camera,z,fov), screenh, screenw);
+}
+
+//////////////////
+// Vertex cache //
+//////////////////
+
+struct Plane;
+struct RoomWindow;
+
+// Contexts drawing parts of the same frame can share these, so rooms and walls are counted by whichever one gets to them first.
+// Marks are swapped atomically, and the stamps of a frame are only compared with each other, so they never need clearing.
+struct RenderCounts {
+	// The map the marks were made for, and the revision its wall slots were laid out in at the time
+	struct Map* map;
+	uint64_t slots_revision;
+	// The frame each room and wall slot was last counted in
+	unsigned* room_counted;
+	unsigned* wall_counted;
+	unsigned frame;
+};
+
+// The camera space position of every wall vertex in the map this frame, in the same slots as the map's packed walls, see struct MapWalls.
+// Rooms are transformed all at once the first time they are drawn in a frame, and reused for the rest of it.
+// Everything else about the walls is read from the map, which has one packed copy shared by every context.
+struct RenderContext {
+	// The map the cache was made for, and the revision its wall slots were laid out in at the time
+	struct Map* map;
+	uint64_t slots_revision;
+	// Camera space vertex positions
+	real* camera_x;
+	real* camera_y;
+	// The frame each room was last transformed in
+	unsigned* room_frame;
+	unsigned frame;
+	// Scratch memory for the current frame, the arrays below are taken from it and start empty every frame
+	Arena* arena;
+	// Textured floors and ceilings waiting to be drawn, see the planes section
+	struct Plane* planes;
+	int plane_count, plane_capacity;
+	int* plane_bounds;
+	size_t plane_bounds_length, plane_bounds_capacity;
+	// Every room drawn this frame
+	struct RoomVisit* visits;
+	int visit_count, visit_capacity;
+	// Rooms waiting to be drawn by render_room, see the traversal section
+	RenderSettings settings;
+	struct RoomWindow* windows;
+	int window_head, window_count, window_capacity;
+	// Called after every column drawn, if set
+	void (*debug_hook)(Canvas* canvas);
+	// Counters for this frame, and the marks of what they've counted, which are own_counts unless shared
+	RenderStats stats;
+	RenderCounts* counts;
+	RenderCounts own_counts;
+	// Inverse depth of the solid wall drawn in each column, 0 where there isn't one, for hiding sprites behind walls
+	real* wall_depth;
+	// Rooms drawn this frame that have entities in them, see the sprites section
+	struct SpriteRoom* sprite_rooms;
+	int sprite_room_count, sprite_room_capacity;
+	// The index in windows of each room's last window, it may have been drawn already
+	int* room_window;
+};
+
+RenderContext* render_context_create() {
+	RenderContext* context = calloc(1, sizeof(RenderContext));
+	context->settings = RENDER_DEFAULT_SETTINGS;
+	context->arena = arena_create(64 * 1024);
+	context->counts = &context->own_counts;
+	light_init();
+	return context;
+}
+
+void render_context_settings(RenderContext* context, RenderSettings settings) {
+	context->settings = settings;
+}
+
+void render_context_debug_hook(RenderContext* context, void (*hook)(Canvas* canvas)) {
+	context->debug_hook = hook;
+}
+
+void free_vertex_cache(RenderContext* context) {
+	free(context->camera_x);
+	free(context->camera_y);
+	free(context->room_frame);
+	free(context->room_window);
+}
+
+void free_counts(RenderCounts* counts) {
+	free(counts->room_counted);
+	free(counts->wall_counted);
+}
+
+void render_context_free(RenderContext* context) {
+	free_vertex_cache(context);
+	free_counts(&context->own_counts);
+	arena_free(context->arena);
+	free(context);
+}
+
+// Make the cache for a diffrent map, or after its wall slots were laid out again
+void build_vertex_cache(RenderContext* context, struct Map* map) {
+	free_vertex_cache(context);
+	context->map = map;
+	context->slots_revision = map->walls.revision;
+	context->room_frame = calloc(map->length ? map->length : 1, sizeof(unsigned));
+	context->room_window = calloc(map->length ? map->length : 1, sizeof(int));
+	int slots = map->walls.slot_start[map->length];
+	context->camera_x = malloc(sizeof(real) * (slots ? slots : 1));
+	context->camera_y = malloc(sizeof(real) * (slots ? slots : 1));
+}
+
+void render_context_begin_frame(RenderContext* context, struct Map* map) {
+	if (context->map != map || context->slots_revision != map->walls.revision) build_vertex_cache(context, map);
+	context->frame++;
+
+	// Throw away last frame's scratch memory
+	arena_reset(context->arena);
+	context->planes = NULL;
+	context->plane_count = context->plane_capacity = 0;
+	context->plane_bounds = NULL;
+	context->plane_bounds_length = context->plane_bounds_capacity = 0;
+	context->visits = NULL;
+	context->visit_count = context->visit_capacity = 0;
+	context->windows = NULL;
+	context->window_count = context->window_capacity = 0;
+	context->wall_depth = NULL;
+	context->sprite_rooms = NULL;
+	context->sprite_room_count = context->sprite_room_capacity = 0;
+	if (context->counts == &context->own_counts) render_counts_begin_frame(context->counts, map);
+	memset(&context->stats, 0, sizeof(RenderStats));
+}
+
+RenderStats* render_context_stats(RenderContext* context) {
+	// Walls are only counted as drawn once, so whatever wasn't drawn anywhere was thrown away
+	context->stats.walls_clipped = context->stats.walls_tested - context->stats.walls_drawn;
+	return &context->stats;
+}
+
+RenderCounts* render_counts_create() {
+	return calloc(1, sizeof(RenderCounts));
+}
+
+void render_counts_free(RenderCounts* counts) {
+	free_counts(counts);
+	free(counts);
+}
+
+void render_counts_begin_frame(RenderCounts* counts, struct Map* map) {
+	if (counts->map != map || counts->slots_revision != map->walls.revision) {
+		free_counts(counts);
+		counts->map = map;
+		counts->slots_revision = map->walls.revision;
+		counts->room_counted = calloc(map->length ? map->length : 1, sizeof(unsigned));
+		int slots = map->walls.slot_start[map->length];
+		counts->wall_counted = calloc(slots ? slots : 1, sizeof(unsigned));
+	}
+	// Stamps start at 0, so the first frame is 1
+	counts->frame++;
+}
+
+void render_context_share_counts(RenderContext* context, RenderCounts* counts) {
+	context->counts = counts ? counts : &context->own_counts;
+}
+
+// Mark something as counted this frame, returns 1 if nothing had counted it yet
+int count_once(RenderCounts* counts, unsigned* marks, int index) {
+	return __atomic_exchange_n(&marks[index], counts->frame, __ATOMIC_RELAXED) != counts->frame;
+}
+
+Arena* render_context_arena(RenderContext* context) {
+	return context->arena;
+}
+
+struct RoomVisit* render_context_visits(RenderContext* context, int* count) {
+	*count = context->visit_count;
+	return context->visits;
+}
+
+// Transform a batch of vertices into camera space, this is written to be easily vectorized.
+void transform_vertices(
+	int length, const float* restrict world_x, const float* restrict world_y,
+	real* restrict camera_x, real* restrict camera_y,
+	real origin_x, real origin_y, real angle_cos, real angle_sin
+) {
+	for (int i = 0; i < length; i++) {
+		real x = world_x[i] - origin_x;
+		real y = world_y[i] - origin_y;
+		camera_x[i] = x * angle_cos - y * angle_sin;
+		camera_y[i] = x * angle_sin + y * angle_cos;
+	}
+}
+
+// Get the slot of a room's walls, with the camera space vertices in the cache, transforming them if needed.
+int room_vertices(RenderContext* context, struct Camera* camera, int roomid) {
+	struct MapWalls* walls = &context->map->walls;
+	int start = walls->slot_start[roomid];
+	if (context->room_frame[roomid] != context->frame) {
+		map_pack_walls(context->map, roomid);
+		transform_vertices(
+			context->map->rooms[roomid]->length,
+			&walls->x[start], &walls->y[start],
+			&context->camera_x[start], &context->camera_y[start],
+			camera->location.x, camera->location.y, camera->angle_cos, camera->angle_sin
+		);
+		context->room_frame[roomid] = context->frame;
+	}
+	return start;
+}
+
+/////////////
+// Cliping //
+/////////////
+
+// Find where the line from a to b crosses a line, given the signed distance of a and b from it.
+RenderPoint clip_point(RenderPoint a, RenderPoint b, real distance_a, real distance_b) {
+	real t = distance_a / (distance_a - distance_b);
+	return (RenderPoint) {a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t};
+}
+
+// This computes how much of a wall is visable, storing the start and end in w1 and w0
+// Returns false if the wall is fully outside, true otherwize
+int clip_to_frustum(RenderPoint* w0, RenderPoint* w1, real fov) {
+	real near_plane = 0.00001;
+
+	// Clip to the near plane
+	
+	// If both are behind the near plane, reject the wall
+	if (w0->y < near_plane && w1->y < near_plane) return 0;
+
+	// If only one is, move it 
+	RenderPoint a = *w0, b = *w1;
+	if (a.y < near_plane) *w0 = clip_point(a, b, a.y - near_plane, b.y - near_plane);
+	if (b.y < near_plane) *w1 = clip_point(a, b, a.y - near_plane, b.y - near_plane);
+
+	// Clip by angle, to the lines x = fov * y and x = -fov * y, everything is in front of the camera now so this is the same as comparing x / y to fov.
+	a = *w0;
+	b = *w1;
+	real right0 = a.x - fov * a.y, right1 = b.x - fov * b.y;
+	real left0 = a.x + fov * a.y, left1 = b.x + fov * b.y;
+	
+	// If both endpoints are out of view, on the same side, reject the wall
+	if (right0 > 0 && right1 > 0) return 0;
+	if (left0 < 0 && left1 < 0) return 0;
+	
+	// Otherwize, move the points inside of the view.
+	if (right0 > 0) *w0 = clip_point(a, b, right0, right1);
+	if (right1 > 0) *w1 = clip_point(a, b, right0, right1);
+	if (left0 < 0) *w0 = clip_point(a, b, left0, left1);
+	if (left1 < 0) *w1 = clip_point(a, b, left0, left1);
+
+	return 1;
+}
+
+//////////////
+// Counting //
+//////////////
+
+// Everything drawn by the renderer goes through here, so the pixels can be counted.
+// In overdraw mode, each pixel holds how many times it was drawn, and is only given a color by render_heatmap.
+
+// Colors for pixels drawn 0 to 7 or more times
+const uint32_t heat_colors[] = {
+	0x000000ff, 0x000080ff, 0x0080ffff, 0x00c000ff, 0xffff00ff, 0xff8000ff, 0xff0000ff, 0xffffffff,
+};
+#define HEAT_COLORS (int)(sizeof(heat_colors) / sizeof(heat_colors[0]))
+
+void render_clear(RenderContext* context, Canvas* canvas, int x_min, int x_max) {
+	// The canvas is stored by column, so the columns being drawn are a smaller canvas of their own.
+	canvas_fill(&(Canvas) {canvas_column(canvas, x_min), x_max - x_min, canvas->h}, context->settings.overdraw ? 0 : 0xff00ffff);
+}
+
+void render_heatmap(RenderContext* context, Canvas* canvas, int x_min, int x_max) {
+	if (!context->settings.overdraw) return;
+	for (int x = x_min; x < x_max; x++) {
+		uint32_t* column = canvas_column(canvas, x);
+		for (int y = 0; y < canvas->h; y++) column[y] = heat_colors[MIN(column[y], HEAT_COLORS - 1)];
+	}
+}
+
+// Draw a solid vertical line from y0 to y1, and count it as primitive
+void draw_vline(RenderContext* context, Canvas* canvas, enum RenderPrimitive primitive, int x, int y0, int y1, int r, int g, int b) {
+	if (y0 >= y1) return;
+	context->stats.pixels[primitive] += y1 - y0;
+	if (context->settings.overdraw) {
+		uint32_t* column = canvas_column(canvas, x);
+		for (int y = y0; y < y1; y++) column[y]++;
+	} else {
+		vline(canvas, x, y0, y1, r, g, b);
+	}
+}
+
+////////////
+// Planes //
+////////////
+
+// Textured floors and ceilings aren't drawn while walking the rooms, since every pixel down a column is at a diffrent depth.
+// Instead the rows they cover are collected, one plane per floor or ceiling of each room drawn, and drawn after as horizontal spans.
+// Every pixel in a span is at the same depth, so the texture cordinates only take one divide per span, and are then stepped.
+
+struct Plane {
+	real z;
+	int texture;
+	// Light of the room the plane is in
+	int light;
+	int x_min, x_max;
+	// Index in plane_bounds of the first row and the row after the last for every column, starting with x_min
+	size_t bounds;
+};
+
+// Start a plane at height z and lit by light, covering from x_min to x_max, with nothing in it yet.
+// Returns the index of the plane, or -1 if the texture isn't loaded, in which case the floor or ceiling should be drawn flat.
+int plane_begin(RenderContext* context, struct Map* map, int texture, int light, real z, int x_min, int x_max) {
+	if (!map->textures || texture < 0 || texture >= map->textures->count || x_min >= x_max) return -1;
+
+	if (context->plane_count == context->plane_capacity) {
+		int capacity = MAX(context->plane_capacity * 2, 64);
+		context->planes = arena_grow(context->arena, context->planes, sizeof(struct Plane) * context->plane_capacity, sizeof(struct Plane) * capacity);
+		context->plane_capacity = capacity;
+	}
+	size_t length = (size_t)(x_max - x_min) * 2;
+	if (context->plane_bounds_length + length > context->plane_bounds_capacity) {
+		size_t capacity = MAX(context->plane_bounds_capacity * 2, context->plane_bounds_length + length);
+		context->plane_bounds = arena_grow(context->arena, context->plane_bounds, sizeof(int) * context->plane_bounds_capacity, sizeof(int) * capacity);
+		context->plane_bounds_capacity = capacity;
+	}
+
+	struct Plane* plane = &context->planes[context->plane_count];
+	plane->z = z;
+	plane->texture = texture;
+	plane->light = light;
+	plane->x_min = x_min;
+	plane->x_max = x_max;
+	plane->bounds = context->plane_bounds_length;
+	memset(&context->plane_bounds[plane->bounds], 0, sizeof(int) * length);
+	context->plane_bounds_length += length;
+	return context->plane_count++;
+}
+
+// Add the rows from y0 to y1 of column x to a plane
+void plane_column(RenderContext* context, int plane_index, int x, int y0, int y1) {
+	struct Plane* plane = &context->planes[plane_index];
+	int* bounds = &context->plane_bounds[plane->bounds + (size_t)(x - plane->x_min) * 2];
+	bounds[0] = y0;
+	bounds[1] = y1;
+}
+
+// Draw row y of a plane from column x0 to x1
+void plane_span(RenderContext* context, Canvas* canvas, struct Camera* camera, struct Plane* plane, TextureAtlas* atlas, int y, int x0, int x1) {
+	context->stats.pixels[RENDER_PLANES] += x1 - x0;
+	if (context->settings.overdraw) {
+		for (int x = x0; x < x1; x++) canvas_column(canvas, x)[y]++;
+		return;
+	}
+
+	// Find the depth of the row from where the center of its pixels is on the normalized screen
+	real screen_y = 1 - (y + (real)0.5) * 2 / canvas->h;
+	real depth = (plane->z - camera->z) / (screen_y * FOV);
+	if (!(depth > 0)) return;
+
+	// Moving one pixel right moves this far along the camera's x axis.
+	// Texture cordinates are found for the left edge of the screen, so spans on the same row line up wherever they start.
+	// Textures repeat every unit, so only the fraction of the camera's location is needed, which keeps precision far from the origin.
+	real step = 2 * FOV * depth / canvas->w;
+	RenderPoint offset = camera_to_world_direction(camera, (RenderPoint) {((real)0.5 * 2 / canvas->w - 1) * FOV * depth, depth});
+	real u = camera->location.x - floor(camera->location.x) + offset.x;
+	real v = camera->location.y - floor(camera->location.y) + offset.y;
+	textured_hspan(
+		&canvas_column(canvas, x0)[y], canvas->h, x0, x1 - x0,
+		u, v, camera->angle_cos * step, -camera->angle_sin * step,
+		atlas, plane->texture, colormaps[light_level(plane->light, 1 / depth)]
+	);
+}
+
+void render_planes(RenderContext* context, Canvas* canvas, struct Camera* camera) {
+	// Column each row's current span started at
+	int* span_start = arena_alloc(context->arena, sizeof(int) * canvas->h);
+	TextureAtlas* atlas = context->map->textures;
+
+	for (int i = 0; i < context->plane_count; i++) {
+		struct Plane* plane = &context->planes[i];
+		int* bounds = &context->plane_bounds[plane->bounds];
+
+		// Go across the plane, ending the spans of rows the last column had but this one doesn't, and starting new ones.
+		// One past the end is treated as empty, so every span is ended.
+		int last_top = 0, last_bottom = 0;
+		for (int x = plane->x_min; x <= plane->x_max; x++) {
+			int top = 0, bottom = 0;
+			if (x < plane->x_max && bounds[0] < bounds[1]) {
+				top = bounds[0];
+				bottom = bounds[1];
+			}
+			bounds += 2;
+
+			for (int y = last_top; y < MIN(last_bottom, top); y++) plane_span(context, canvas, camera, plane, atlas, y, span_start[y], x);
+			for (int y = MAX(last_top, bottom); y < last_bottom; y++) plane_span(context, canvas, camera, plane, atlas, y, span_start[y], x);
+			for (int y = top; y < MIN(bottom, last_top); y++) span_start[y] = x;
+			for (int y = MAX(top, last_bottom); y < bottom; y++) span_start[y] = x;
+			last_top = top;
+			last_bottom = bottom;
+		}
+	}
+	context->plane_count = 0;
+	context->plane_bounds_length = 0;
+}
+
+/////////////
+// Sprites //
+/////////////
+
+// Entities are drawn after everything else, as billboards facing the camera.
+// Only entities in rooms that were drawn are looked at. When a room with entities is drawn, the clip bounds of its columns are saved,
+// so its sprites are clipped to the portals the room was seen through. They are also hidden behind the closest solid wall in each column.
+
+struct SpriteRoom {
+	int room;
+	int x_min, x_max;
+	// Clip bounds of columns x_min to x_max when the room was drawn
+	int* y_min;
+	int* y_max;
+};
+
+struct Sprite {
+	// Distance in front of the camera
+	real depth;
+	// Left, right, top and bottom edges in pixels
+	real x0, x1, y0, y1;
+	int texture;
+	struct SpriteRoom* room;
+};
+
+// Save the clip bounds of a room being drawn, if it has entities in it
+void sprite_room(RenderContext* context, struct Map* map, int roomid, int x_min, int x_max, int y_min[], int y_max[]) {
+	if (map->entities[roomid].length == 0) return;
+	if (context->sprite_room_count == context->sprite_room_capacity) {
+		int capacity = MAX(context->sprite_room_capacity * 2, 16);
+		context->sprite_rooms = arena_grow(context->arena, context->sprite_rooms, sizeof(struct SpriteRoom) * context->sprite_room_capacity, sizeof(struct SpriteRoom) * capacity);
+		context->sprite_room_capacity = capacity;
+	}
+	struct SpriteRoom* room = &context->sprite_rooms[context->sprite_room_count++];
+	room->room = roomid;
+	room->x_min = x_min;
+	room->x_max = x_max;
+	room->y_min = arena_alloc(context->arena, sizeof(int) * (x_max - x_min));
+	room->y_max = arena_alloc(context->arena, sizeof(int) * (x_max - x_min));
+	memcpy(room->y_min, &y_min[x_min], sizeof(int) * (x_max - x_min));
+	memcpy(room->y_max, &y_max[x_min], sizeof(int) * (x_max - x_min));
+}
+
+// Sort sprites from farthest to closest, with a merge sort through scratch, which must hold as many sprites.
+// Sprites at the same depth keep their order, so the frame doesn't depend on the sort.
+void sort_sprites(struct Sprite* sprites, int count, struct Sprite* scratch) {
+	for (int width = 1; width < count; width *= 2) {
+		for (int start = 0; start < count; start += width * 2) {
+			int middle = MIN(start + width, count), end = MIN(start + width * 2, count);
+			int a = start, b = middle, out = start;
+			while (a < middle && b < end) scratch[out++] = sprites[b].depth > sprites[a].depth ? sprites[b++] : sprites[a++];
+			while (a < middle) scratch[out++] = sprites[a++];
+			while (b < end) scratch[out++] = sprites[b++];
+		}
+		memcpy(sprites, scratch, sizeof(struct Sprite) * count);
+	}
+}
+
+// Draw a sprite, in the columns of its room that aren't behind a wall
+void draw_sprite(RenderContext* context, Canvas* canvas, struct Sprite* sprite) {
+	struct SpriteRoom* room = sprite->room;
+	TextureAtlas* atlas = context->map->textures;
+	int textured = atlas && sprite->texture >= 0 && sprite->texture < atlas->count;
+	real inverse_depth = 1 / sprite->depth;
+	const uint8_t* colormap = colormaps[light_level(context->map->rooms[room->room]->light, inverse_depth)];
+
+	// Like walls, sprites cover the pixels whose centers they cover
+	int x0 = MAX(room->x_min, (int)ceil(sprite->x0 - (real)0.5));
+	int x1 = MIN(room->x_max, (int)ceil(sprite->x1 - (real)0.5));
+	int top = ceil(sprite->y0 - (real)0.5), bottom = ceil(sprite->y1 - (real)0.5);
+	for (int x = x0; x < x1; x++) {
+		if (inverse_depth <= context->wall_depth[x]) continue;
+		int y0 = MIN(MAX(top, room->y_min[x - room->x_min]), room->y_max[x - room->x_min]);
+		int y1 = MAX(MIN(bottom, room->y_max[x - room->x_min]), y0);
+		if (textured && !context->settings.overdraw) {
+			real u = (x + (real)0.5 - sprite->x0) / (sprite->x1 - sprite->x0);
+			context->stats.pixels[RENDER_SPRITES] += sprite_vline(canvas_column(canvas, x), y0, y1, sprite->y0, sprite->y1, u, atlas, sprite->texture, colormap);
+		} else {
+			draw_vline(context, canvas, RENDER_SPRITES, x, y0, y1, colormap[255], colormap[255], colormap[255]);
+		}
+	}
+}
+
+void render_sprites(RenderContext* context, Canvas* canvas, struct Camera* camera) {
+	struct Map* map = context->map;
+	int count = 0;
+	for (int i = 0; i < context->sprite_room_count; i++) count += map->entities[context->sprite_rooms[i].room].length;
+	if (count == 0) return;
+
+	// Project every entity in the rooms that were drawn, throwing away the ones behind the camera or outside the room's columns
+	struct Sprite* sprites = arena_alloc(context->arena, sizeof(struct Sprite) * count);
+	count = 0;
+	for (int i = 0; i < context->sprite_room_count; i++) {
+		struct SpriteRoom* room = &context->sprite_rooms[i];
+		struct RoomEntities* list = &map->entities[room->room];
+		for (int j = 0; j < list->length; j++) {
+			struct Entity* entity = &list->entities[j];
+			real x = entity->location.x - camera->location.x;
+			real y = entity->location.y - camera->location.y;
+			RenderPoint center = {x * camera->angle_cos - y * camera->angle_sin, x * camera->angle_sin + y * camera->angle_cos};
+			if (center.y < (real)0.01) continue;
+
+			RenderPoint top_left = camera_to_pixel_space(
+				(RenderPoint) {center.x - entity->width / 2, center.y}, entity->z + entity->height - camera->z, canvas->h, canvas->w, FOV
+			);
+			RenderPoint bottom_right = camera_to_pixel_space(
+				(RenderPoint) {center.x + entity->width / 2, center.y}, entity->z - camera->z, canvas->h, canvas->w, FOV
+			);
+			if (bottom_right.x <= room->x_min || top_left.x >= room->x_max) continue;
+			// Only the room's columns with the sprite's middle in count it, so a sprite split between strips or portals counts once
+			int middle = floor((top_left.x + bottom_right.x) / 2);
+			if (middle >= room->x_min && middle < room->x_max) context->stats.sprites++;
+			sprites[count++] = (struct Sprite) {center.y, top_left.x, bottom_right.x, top_left.y, bottom_right.y, entity->texture, room};
+		}
+	}
+
+	// Draw from back to front, so closer sprites cover farther ones
+	sort_sprites(sprites, count, arena_alloc(context->arena, sizeof(struct Sprite) * count));
+	for (int i = 0; i < count; i++) draw_sprite(context, canvas, &sprites[i]);
+}
+
+//////////////
+// Renderer //
+////////////// 
+
+void camera_prepare(struct Camera* camera) {
+	camera->angle_cos = cos(camera->angle);
+	camera->angle_sin = sin(camera->angle);
+}
+
+///////////////
+// Traversal //
+///////////////
+
+// render_room keeps a list of rooms to draw, and the columns to draw them in.
+// Drawing a room narrows the clip bounds of the columns behind each of its portals, and adds the room behind to the list.
+// Windows waiting in the list never share columns, since each is inside a portal of a room that was already drawn,
+// so they can be drawn in any order, and each column's clip bounds are only changed by the window covering it.
+
+struct RoomWindow {
+	int room;
+	int x_min, x_max;
+	// How many portals away from the first room this is
+	int depth;
+};
+
+// Add a room to the list to draw.
+// If the room is already waiting in the list, in columns right next to these, the windows are merged, so the room is only drawn once.
+void queue_room(RenderContext* context, int roomid, int x_min, int x_max, int depth) {
+	int last = context->room_window[roomid];
+	if (last >= context->window_head && last < context->window_count) {
+		struct RoomWindow* window = &context->windows[last];
+		if (window->room == roomid && x_min <= window->x_max && x_max >= window->x_min) {
+			window->x_min = MIN(window->x_min, x_min);
+			window->x_max = MAX(window->x_max, x_max);
+			window->depth = MIN(window->depth, depth);
+			return;
+		}
+	}
+
+	if (context->window_count == context->window_capacity) {
+		int capacity = MAX(context->window_capacity * 2, 64);
+		context->windows = arena_grow(context->arena, context->windows, sizeof(struct RoomWindow) * context->window_capacity, sizeof(struct RoomWindow) * capacity);
+		context->window_capacity = capacity;
+	}
+	context->room_window[roomid] = context->window_count;
+	context->windows[context->window_count++] = (struct RoomWindow) {roomid, x_min, x_max, depth};
+}
+
+// Take the next room to draw off the list
+struct RoomWindow next_room(RenderContext* context) {
+	if (context->settings.order == RENDER_BREADTH_FIRST) return context->windows[context->window_head++];
+	return context->windows[--context->window_count];
+}
+
+// Remember where a room was drawn, so the columns can be redrawn if it changes
+void add_visit(RenderContext* context, int roomid, int x_min, int x_max) {
+	if (context->visit_count == context->visit_capacity) {
+		int capacity = MAX(context->visit_capacity * 2, 64);
+		context->visits = arena_grow(context->arena, context->visits, sizeof(struct RoomVisit) * context->visit_capacity, sizeof(struct RoomVisit) * capacity);
+		context->visit_capacity = capacity;
+	}
+	context->visits[context->visit_count++] = (struct RoomVisit) {roomid, x_min, x_max};
+}
+
+// Draw one room within the x bounds, and queue the rooms behind its portals
+void draw_room(RenderContext* context, Canvas* canvas, struct Camera* camera, int roomid, int depth, struct Map* map, int x_min, int x_max, int y_min[], int y_max[]) {
+	int h = canvas->h;
+	int w = canvas->w;
+	struct Room* room = map->rooms[roomid];
+	struct MapWalls* walls = &map->walls;
+	int vertices = room_vertices(context, camera, roomid);
+	// Textures are packed before they are loaded, so ones that didn't load are left out here
+	int texture_count = map->textures ? map->textures->count : 0;
+
+	add_visit(context, roomid, x_min, x_max);
+	RenderCounts* counts = context->counts;
+	if (count_once(counts, counts->room_counted, roomid)) {
+		context->stats.rooms++;
+		context->stats.walls_tested += room->length;
+	}
+	context->stats.max_depth = MAX(context->stats.max_depth, depth);
+	sprite_room(context, map, roomid, x_min, x_max, y_min, y_max);
+
+	int floor_plane = plane_begin(context, map, room->floor_texture, room->light, room->z0, x_min, x_max);
+	int ceiling_plane = plane_begin(context, map, room->ceiling_texture, room->light, room->z1, x_min, x_max);
+
+	// Draw every wall in a room
+	for (int wallid = 0; wallid < room->length; wallid++) {
+		// Find the endpoints of the wall, walls are read from the map's packed copy rather than the room
+		int wall = vertices + wallid;
+		int next = vertices + (wallid + 1 < room->length ? wallid + 1 : 0);
+		int portal = walls->portal[wall];
+
+		// Portals into rooms that can't be seen from the camera's room can't be on screen, so skip them before any projection.
+		if (portal != -1 && !pvs_visible(map, camera->room_idx, portal)) continue;
+
+		// Get the camera relative cordinates
+		RenderPoint v0 = {context->camera_x[wall], context->camera_y[wall]};
+		RenderPoint v1 = {context->camera_x[next], context->camera_y[next]};
+		RenderPoint p0 = v0;
+		RenderPoint p1 = v1;
+
+		// Walls facing away from the camera would end up right to left on screen, so they can be thrown away before clipping.
+		// Clipping only moves the ends along the wall, which doesn't change which side of it the camera is on.
+		if (v0.y * v1.x - v0.x * v1.y <= 0) continue;
+		
+		// Don't render walls if behind the camera
+		if (!clip_to_frustum(&p0, &p1, FOV)) continue;
+		
+		// Project wall endpoints to screen space
+		RenderPoint w0_upper = camera_to_pixel_space(p0, room->z1 - camera->z, h, w, FOV);
+		RenderPoint w0_lower = camera_to_pixel_space(p0, room->z0 - camera->z, h, w, FOV);
+		RenderPoint w1_upper = camera_to_pixel_space(p1, room->z1 - camera->z, h, w, FOV);
+		RenderPoint w1_lower = camera_to_pixel_space(p1, room->z0 - camera->z, h, w, FOV);
+
+		// Find the horisontal texture cordinates, as the distance along the wall from its first vertex, one repeat per unit.
+		// This is measured in camera space, which has the same distances as world space, but keeps its precision far from the origin.
+		// These are divided by depth, so they can be interpolated across the screen with perspective
+		// Unless an end was clipped off, it is at the start or the end of the wall, so the distance is already known.
+		int texture = walls->texture[wall] < texture_count ? walls->texture[wall] : -1;
+		real u0_over_depth = 0, u1_over_depth = 0;
+		if (texture != -1) {
+			real u0 = p0.x == v0.x && p0.y == v0.y ? 0 : hypot(p0.x - v0.x, p0.y - v0.y);
+			real u1 = p1.x == v1.x && p1.y == v1.y ? (real)walls->length[wall] : hypot(p1.x - v0.x, p1.y - v0.y);
+			u0_over_depth = u0 / p0.y;
+			u1_over_depth = u1 / p1.y;
+		}
+		
+		// In the case of portals, do some more projection to find where the top and bottom portions of the portal should be
+		RenderPoint portal0_lower, portal0_upper, portal1_lower, portal1_upper;
+		if (portal != -1) {
+			real bottom_height = walls->step_bottom[wall];
+			real top_height = walls->step_top[wall];
+			portal0_lower = camera_to_pixel_space(p0, room->z0 - camera->z + bottom_height, h, w, FOV);
+			portal0_upper = camera_to_pixel_space(p0, room->z1 - camera->z - top_height, h, w, FOV);
+			portal1_lower = camera_to_pixel_space(p1, room->z0 - camera->z + bottom_height, h, w, FOV);
+			portal1_upper = camera_to_pixel_space(p1, room->z1 - camera->z - top_height, h, w, FOV);
+		}
+
+		// Limit the draw portion of the wall to the screen
+		// A wall draws the columns whose centers it covers, so walls next to each other never both draw the column they meet in.
+		int x0 = MAX(x_min, (int)ceil(w0_upper.x - (real)0.5));
+		int x1 = MIN(x_max, (int)ceil(w1_upper.x - (real)0.5));
+		
+		// Dont draw walls facing away from the player, or with zero size.
+		if (x0 >= x1) continue;
+		if (count_once(counts, counts->wall_counted, wall)) {
+			context->stats.walls_drawn++;
+			if (portal != -1) context->stats.portals++;
+		}
+
+		// Everything drawn changes linearly across the screen, so find it at the center of the wall's first column, and how much it changes each column.
+		// Columns are found from the first column of the whole wall, not where drawing starts, so they come out the same however the screen is split up.
+		int first = ceil(w0_upper.x - (real)0.5);
+		real step = 1 / (w1_upper.x - w0_upper.x);
+		real start = (first + (real)0.5 - w0_upper.x) * step;
+		Edge top_start = EDGE(w0_upper.y + (w1_upper.y - w0_upper.y) * start), top_step = EDGE((w1_upper.y - w0_upper.y) * step);
+		Edge bottom_start = EDGE(w0_lower.y + (w1_lower.y - w0_lower.y) * start), bottom_step = EDGE((w1_lower.y - w0_lower.y) * step);
+		Edge portal_top_start = 0, portal_top_step = 0, portal_bottom_start = 0, portal_bottom_step = 0;
+		if (portal != -1) {
+			portal_top_start = EDGE(portal0_upper.y + (portal1_upper.y - portal0_upper.y) * start);
+			portal_top_step = EDGE((portal1_upper.y - portal0_upper.y) * step);
+			portal_bottom_start = EDGE(portal0_lower.y + (portal1_lower.y - portal0_lower.y) * start);
+			portal_bottom_step = EDGE((portal1_lower.y - portal0_lower.y) * step);
+		}
+		int r = walls->color[wall] >> 24, g = walls->color[wall] >> 16 & 0xff, b = walls->color[wall] >> 8 & 0xff;
+		// The texture cordinate, and one over depth to undo the division by depth
+		real u_start = u0_over_depth + (u1_over_depth - u0_over_depth) * start, u_step = (u1_over_depth - u0_over_depth) * step;
+		real inverse_depth_start = 1 / p0.y + (1 / p1.y - 1 / p0.y) * start, inverse_depth_step = (1 / p1.y - 1 / p0.y) * step;
+
+		// For every pixel along the wall, draw the floor, ceiling, and the wal
+		for (int x = x0; x < x1; x++) {
+			int column = x - first;
+			Edge top = top_start + top_step * column;
+			Edge bottom = bottom_start + bottom_step * column;
+			// The wall is all at one depth down the column, so its light is too.
+			// Flat floors and ceilings use it as well, which is right where they meet the wall.
+			real inverse_depth = inverse_depth_start + inverse_depth_step * column;
+			const uint8_t* colormap = colormaps[light_level(room->light, inverse_depth)];
+
+			// Limit the wall to within the y bounds
+			int y0 = MIN(MAX(y_min[x], EDGE_ROW(top)), y_max[x]);
+			int y1 = MAX(MIN(y_max[x], EDGE_ROW(bottom)), y_min[x]);
+
+			// Draw in the floor and ceiling, and in the case of a normal wall, draw it in.
+			if (ceiling_plane == -1) draw_vline(context, canvas, RENDER_FLATS, x, y_min[x], y0, colormap[0], colormap[0], colormap[64]);
+			else plane_column(context, ceiling_plane, x, y_min[x], y0);
+			if (floor_plane == -1) draw_vline(context, canvas, RENDER_FLATS, x, y1, y_max[x], colormap[64], colormap[64], colormap[64]);
+			else plane_column(context, floor_plane, x, y1, y_max[x]);
+			if (portal == -1) {
+				context->wall_depth[x] = inverse_depth;
+				if (texture != -1 && !context->settings.overdraw) {
+					// The texture runs down from the ceiling, so it lines up between rooms with the same ceiling
+					real u = (u_start + u_step * column) / inverse_depth;
+					textured_vline(
+						canvas_column(canvas, x), y0, y1, EDGE_VALUE(top), EDGE_VALUE(bottom), u, 0, room->z1 - room->z0,
+						map->textures, texture, colormap
+					);
+					context->stats.pixels[RENDER_WALLS] += y1 - y0;
+				} else {
+					draw_vline(context, canvas, RENDER_WALLS, x, y0, y1, colormap[r], colormap[g], colormap[b]);
+				}
+			}
+
+			// In the case of a portal, draw the upper and lower segments
+			if (portal != -1) {
+				// Limit the top and bottom of the portal to the bounds
+				int top_y = MIN(MAX(EDGE_ROW(portal_top_start + portal_top_step * column), y_min[x]), y_max[x]);
+				int bottom_y = MAX(MIN(EDGE_ROW(portal_bottom_start + portal_bottom_step * column), y_max[x]), y_min[x]);
+				
+				// Draw the top and bottom
+				draw_vline(context, canvas, RENDER_STEPS, x, y0, top_y, colormap[r], colormap[g], colormap[b]);
+				draw_vline(context, canvas, RENDER_STEPS, x, bottom_y, y1, colormap[r], colormap[g], colormap[b]);
+			
+				// Update the bounds
+				y_min[x] = top_y;
+				y_max[x] = bottom_y;
+			}
+
+			if (context->debug_hook) context->debug_hook(canvas);
+		}
+		
+		if (portal != -1) {
+			// Queue the room beond the portal
+			// The x bounds are simply the space that the portal would have been drawn in if it was a wall
+			// The y bounds are set while drawing the floor, ceiling and top and bottom sections.
+			queue_room(context, portal, x0, x1, depth + 1);
+		}
+	}
+}
+
+void render_room(RenderContext* context, Canvas* canvas, struct Camera* camera, int roomid, struct Map* map, int x_min, int x_max, int y_min[], int y_max[]) {
+	context->window_head = 0;
+	context->window_count = 0;
+	// Nothing is in front of sprites until walls are drawn
+	if (!context->wall_depth) context->wall_depth = arena_alloc(context->arena, sizeof(real) * canvas->w);
+	for (int x = x_min; x < x_max; x++) context->wall_depth[x] = 0;
+	queue_room(context, roomid, x_min, x_max, 0);
+
+	int drawn = 0;
+	while (context->window_head < context->window_count) {
+		struct RoomWindow window = next_room(context);
+		if (window.depth > context->settings.max_depth || drawn >= context->settings.max_rooms) {
+			// Too far or too much work, fill in what would have been seen through the portal
+			for (int x = window.x_min; x < window.x_max; x++) draw_vline(context, canvas, RENDER_FILLS, x, y_min[x], y_max[x], 0, 0, 0);
+			continue;
+		}
+		if (map->rooms[window.room] == &map_missing_room) {
+			// The room hasn't been streamed in yet, so fill it in with grey until it is.
+			// The filling counts as a visit, so it is drawn over when the room comes in.
+			for (int x = window.x_min; x < window.x_max; x++) draw_vline(context, canvas, RENDER_FILLS, x, y_min[x], y_max[x], 48, 48, 48);
+			add_visit(context, window.room, window.x_min, window.x_max);
+			continue;
+		}
+		draw_room(context, canvas, camera, window.room, window.depth, map, window.x_min, window.x_max, y_min, y_max);
+		drawn++;
+	}
+}
+
+void render_frame_columns(RenderContext* context, Canvas* canvas, struct Camera* camera, struct Map* map, int x_min, int x_max) {
+	int w = canvas->w;
+	int h = canvas->h;
+
+	// Prepare a copy, so the caller's camera is left alone and can be shared between threads
+	struct Camera view = *camera;
+	camera = &view;
+	camera_prepare(camera);
+	render_context_begin_frame(context, map);
+
+	// Fill viewport with hot pink to make unrendered areas easly visiable
+	render_clear(context, canvas, x_min, x_max);
+
+	// Initalize bounds for rendering
+	int* y0 = arena_alloc(context->arena, sizeof(int) * w);
+	int* y1 = arena_alloc(context->arena, sizeof(int) * w);
+	for (int i = 0; i < w; i++) y0[i] = 0;
+	for (int i = 0; i < w; i++) y1[i] = h;
+	// Render!
+	render_room(context, canvas, camera, camera->room_idx, map, x_min, x_max, y0, y1);
+	render_planes(context, canvas, camera);
+	render_sprites(context, canvas, camera);
+	render_heatmap(context, canvas, x_min, x_max);
+}
+
+void render_frame(RenderContext* context, Canvas* canvas, struct Camera* camera, struct Map* map) {
+	render_frame_columns(context, canvas, camera, map, 0, canvas->w);
+}
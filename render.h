@@ -0,0 +1,175 @@
+// The software renderer, draws a map from the point of view of a camera into a pixel buffer.
+// Nothing in here depends on SDL, so it can be used without a window.
+#pragma once
+
+#include <stdint.h>
+#include "map.h"
+#include "arena.h"
+
+// A plain pixel buffer in memory.
+// Pixels are RGBA8888 (r << 24 | g << 16 | b << 8 | a), stored column by column, so pixel x, y is at pixels[y + x * h].
+// The renderer draws in vertical lines, so this keeps every line it draws contiguous in memory.
+typedef struct Canvas {
+	uint32_t* pixels;
+	int w, h;
+} Canvas;
+
+// Get a pointer to the top of a column of the canvas
+static inline uint32_t* canvas_column(Canvas* canvas, int x) {
+	return &canvas->pixels[(size_t)x * canvas->h];
+}
+
+// Allocate a canvas, the contents are undefined.
+Canvas* canvas_allocate(int w, int h);
+
+void canvas_free(Canvas* canvas);
+
+// Set every pixel in the canvas to color
+void canvas_fill(Canvas* canvas, uint32_t color);
+
+// Copy the canvas into a normal row by row buffer, with pitch bytes between rows.
+// Used to get the image into a texture or file.
+void canvas_transpose(Canvas* canvas, void* out, int pitch);
+
+// The number type the renderer was built with, "float", "double" or "fixed", see the top of render.c
+const char* render_numeric();
+
+// Draw a solid vertical line from y0 (inclusive) to y1 (exclusive)
+void vline(Canvas* canvas, int x, int y0, int y1, int r, int g, int b);
+
+// Renderer state that is kept between frames, such as the camera space vertex cache.
+// A context must only be used by one thread at a time.
+typedef struct RenderContext RenderContext;
+
+// The order render_room draws rooms in, the frame looks the same either way unless the limits in RenderSettings are reached.
+enum RenderOrder {
+	// Follow each portal as far as it goes before the next one
+	RENDER_DEPTH_FIRST,
+	// Draw every room one portal away from the first room, then every room two portals away, and so on.
+	// When the room limit is reached, the farthest rooms are the ones left out.
+	RENDER_BREADTH_FIRST,
+};
+
+// Limits on how much render_room does, so the cost of a frame is bounded on any map.
+// Parts of the screen showing rooms past the limits are filled with black.
+typedef struct RenderSettings {
+	// The most portals followed from the first room
+	int max_depth;
+	// The most rooms drawn, a room seen through seperate portals counts once for each
+	int max_rooms;
+	enum RenderOrder order;
+	// If set, pixels count how many times they were drawn instead of getting colors, and are shown as a heatmap
+	int overdraw;
+} RenderSettings;
+
+#define RENDER_DEFAULT_SETTINGS ((RenderSettings) {.max_depth = 4096, .max_rooms = 65536, .order = RENDER_DEPTH_FIRST})
+
+RenderContext* render_context_create();
+
+void render_context_free(RenderContext* context);
+
+// Change the limits and order, contexts start with RENDER_DEFAULT_SETTINGS.
+void render_context_settings(RenderContext* context, RenderSettings settings);
+
+// Have the context call hook after every column it draws, or stop with NULL, used for debuging the renderer.
+// The hook is only called by the context it's set on, on whichever thread is drawing with it, contexts in a render pool never have one.
+void render_context_debug_hook(RenderContext* context, void (*hook)(Canvas* canvas));
+
+// Start a new frame, this throws away the cached vertices and scratch memory from the last frame.
+// camera_prepare must be called before the frame is rendered.
+void render_context_begin_frame(RenderContext* context, struct Map* map);
+
+// Scratch memory for the current frame, everything taken from it is given back by render_context_begin_frame.
+Arena* render_context_arena(RenderContext* context);
+
+// Recaculate the sin and cos of the camera angle, this must be done before render_room if the angle changed.
+void camera_prepare(struct Camera* camera);
+
+// The main rendering function, renders a room (roomid) from the the point of view of the camera, to canvas.
+// It follows portals, so any connecting geometry visable trough the room is also drawn.
+// All drawing is within the x bounds given by the x_min and x_max and the y bounds in x_min and y_max.
+// Rooms waiting to be drawn are kept in a list in the context rather than recursing, so there is no limit on how deep the portals go besides the settings.
+void render_room(RenderContext* context, Canvas* canvas, struct Camera* camera, int roomid, struct Map* map, int x_min, int x_max, int y_min[], int y_max[]);
+
+// Draw the textured floors and ceilings found by render_room, this must be called after render_room and before the next frame.
+void render_planes(RenderContext* context, Canvas* canvas, struct Camera* camera);
+
+// Draw the entities in the rooms drawn by render_room as sprites, after render_planes and before the next frame.
+// Sprites are clipped to the portals their room was seen through, and hidden behind solid walls closer than them.
+void render_sprites(RenderContext* context, Canvas* canvas, struct Camera* camera);
+
+// Render a whole frame from the point of view of the camera, covering the entire canvas.
+// The camera isn't changed, so the same one can be drawn from on several threads at once, as long as each has its own context.
+void render_frame(RenderContext* context, Canvas* canvas, struct Camera* camera, struct Map* map);
+
+// Render only the columns from x_min to x_max of a frame, leaving the rest of the canvas as it was.
+void render_frame_columns(RenderContext* context, Canvas* canvas, struct Camera* camera, struct Map* map, int x_min, int x_max);
+
+// A room drawn by render_room, and the columns it could have been drawn in
+struct RoomVisit {
+	int room;
+	int x_min, x_max;
+};
+
+// Get every room drawn since the last render_context_begin_frame, count is set to how many there are.
+struct RoomVisit* render_context_visits(RenderContext* context, int* count);
+
+// The kinds of things the renderer draws, pixels are counted for each one
+enum RenderPrimitive {
+	// Solid and textured walls
+	RENDER_WALLS,
+	// The parts of a portal above and below the opening
+	RENDER_STEPS,
+	// Floors and ceilings without a texture
+	RENDER_FLATS,
+	// Textured floors and ceilings
+	RENDER_PLANES,
+	// Black filling where the limits in RenderSettings stopped drawing, and grey filling for rooms that aren't streamed in yet
+	RENDER_FILLS,
+	// Entities
+	RENDER_SPRITES,
+	RENDER_PRIMITIVES,
+};
+
+// Counters for what the renderer did in a frame, see stats.h for adding them up and showing them
+// Rooms, walls and portals are counted once a frame however many times they're drawn, and sprites once by the column through their middle,
+// so a frame gives the same counts whether it's drawn by one context or split between several, see RenderCounts.
+typedef struct RenderStats {
+	// Rooms drawn, and the most portals followed to get to one of them
+	int rooms, max_depth;
+	// Portals looked through, each one adds the room behind it to the list to draw
+	int portals;
+	// Walls in the rooms drawn, and how many of those were drawn or thrown away as behind the camera, facing away, or outside the columns being drawn.
+	int walls_tested, walls_drawn, walls_clipped;
+	// Sprites drawn
+	int sprites;
+	// Pixels written for each kind of thing drawn, in overdraw mode too
+	long pixels[RENDER_PRIMITIVES];
+} RenderStats;
+
+// Get the counters for everything drawn since the last render_context_begin_frame.
+// For a frame split between contexts sharing a RenderCounts, only the sum over all of them is meaningful.
+RenderStats* render_context_stats(RenderContext* context);
+
+// Marks of the rooms and walls already counted in a frame, shared by contexts that each draw part of it, like the strips of a render pool.
+// Whichever context draws a room or wall first in the frame counts it, so the counters of every context add up to the frame's.
+// Contexts have marks of their own, which are used unless they're given shared ones.
+typedef struct RenderCounts RenderCounts;
+
+RenderCounts* render_counts_create();
+
+void render_counts_free(RenderCounts* counts);
+
+// Start counting a new frame of the map, this must be done before any context sharing the marks begins the frame.
+void render_counts_begin_frame(RenderCounts* counts, struct Map* map);
+
+// Count with shared marks, or with the context's own marks again if counts is NULL.
+void render_context_share_counts(RenderContext* context, RenderCounts* counts);
+
+// Get columns x_min to x_max ready to draw, they're filled with hot pink to make anything that isn't drawn stand out.
+// In overdraw mode they're filled with zero counts instead.
+void render_clear(RenderContext* context, Canvas* canvas, int x_min, int x_max);
+
+// In overdraw mode, turn the counts in columns x_min to x_max into heatmap colors, this is done last, after render_planes.
+// Pixels drawn once are dark blue, then they go through green, yellow and red to white as they are drawn more.
+void render_heatmap(RenderContext* context, Canvas* canvas, int x_min, int x_max);
@@ -0,0 +1,314 @@
+// Multithreaded rendering, see render_pool.h
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <pthread.h>
+#include <time.h>
+#include "render_pool.h"
+
+// State for a single strip of the screen, owned by one thread.
+typedef struct Strip {
+	int x_min, x_max;
+	RenderContext* context;
+	// Private clip bounds, indexed by screen x
+	int* y_min;
+	int* y_max;
+	// How long the strip took to render last frame, in seconds
+	double cost;
+} Strip;
+
+struct RenderPool {
+	int threads;
+	pthread_t* workers;
+	Strip* strips;
+	// Width the strips were last laid out for
+	int w;
+
+	// The frame currently being rendered, the camera is copied so the caller can keep moving it
+	Canvas* canvas;
+	struct Camera camera;
+	struct Map* map;
+	// Columns being drawn this frame
+	int x_min, x_max;
+	// Shared by the strips, so a room or wall drawn in more than one strip is counted once
+	RenderCounts* counts;
+	// Set instead while a batch of views is being drawn, see render_pool_begin_views
+	RenderView* views;
+	// Views are drawn with the strips' contexts, one for each thread drawing them, and this one for the thread waiting on the batch
+	RenderContext* spare_context;
+	int next_context;
+
+	pthread_mutex_t lock;
+	pthread_cond_t start;
+	pthread_cond_t done;
+	// Incremented for every frame, workers start when it changes
+	unsigned long generation;
+	// Strips, or views, in the current batch, and the next one to be picked up by a thread
+	int jobs, next_job;
+	// Jobs not yet finished in the current batch
+	int remaining;
+	// When the current frame was started, and how long the last one took, in seconds
+	double frame_start, frame_time;
+	int quit;
+};
+
+double seconds() {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+// Clear and render the part of a single strip being drawn this frame.
+void render_strip(RenderPool* pool, Strip* strip) {
+	double start = seconds();
+	Canvas* canvas = pool->canvas;
+	int x_min = MAX(strip->x_min, pool->x_min);
+	int x_max = MIN(strip->x_max, pool->x_max);
+
+	for (int x = x_min; x < x_max; x++) {
+		strip->y_min[x] = 0;
+		strip->y_max[x] = canvas->h;
+	}
+	// Hooks would be called from the workers, in the middle of other strips being drawn
+	render_context_debug_hook(strip->context, NULL);
+	render_context_share_counts(strip->context, pool->counts);
+	render_context_begin_frame(strip->context, pool->map);
+	if (x_min < x_max) {
+		// Fill viewport with hot pink to make unrendered areas easly visiable
+		render_clear(strip->context, canvas, x_min, x_max);
+		render_room(strip->context, canvas, &pool->camera, pool->camera.room_idx, pool->map, x_min, x_max, strip->y_min, strip->y_max);
+		render_planes(strip->context, canvas, &pool->camera);
+		render_sprites(strip->context, canvas, &pool->camera);
+		render_heatmap(strip->context, canvas, x_min, x_max);
+	}
+
+	// Only whole frames are used to balance the strips
+	if (pool->x_min == 0 && pool->x_max == canvas->w) strip->cost = seconds() - start;
+}
+
+// Render strips, or views, until every one in the batch has been picked up, the lock must be held.
+void render_jobs(RenderPool* pool) {
+	// Each thread drawing views needs a context of its own for as long as it is drawing them.
+	// Every thread comes through here once a batch, so there are only ever as many as the workers and the thread waiting.
+	RenderContext* context = NULL;
+	if (pool->views && pool->next_job < pool->jobs) {
+		context = pool->next_context < pool->threads ? pool->strips[pool->next_context].context : pool->spare_context;
+		pool->next_context++;
+		// Each view is a frame of its own, so it's counted on its own
+		render_context_share_counts(context, NULL);
+		render_context_debug_hook(context, NULL);
+	}
+	while (pool->next_job < pool->jobs) {
+		int job = pool->next_job++;
+		pthread_mutex_unlock(&pool->lock);
+		if (pool->views) {
+			RenderView* view = &pool->views[job];
+			render_frame(context, view->canvas, &view->camera, pool->map);
+			view->stats = *render_context_stats(context);
+		} else {
+			render_strip(pool, &pool->strips[job]);
+		}
+		pthread_mutex_lock(&pool->lock);
+		if (--pool->remaining == 0) {
+			pool->frame_time = seconds() - pool->frame_start;
+			pthread_cond_broadcast(&pool->done);
+		}
+	}
+}
+
+void* worker_main(void* data) {
+	RenderPool* pool = data;
+	unsigned long generation = 0;
+
+	pthread_mutex_lock(&pool->lock);
+	while (1) {
+		// Wait for a new frame
+		while (pool->generation == generation && !pool->quit)
+			pthread_cond_wait(&pool->start, &pool->lock);
+		if (pool->quit) break;
+		generation = pool->generation;
+		render_jobs(pool);
+	}
+	pthread_mutex_unlock(&pool->lock);
+	return NULL;
+}
+
+RenderPool* render_pool_create(int threads) {
+	if (threads < 1) threads = 1;
+	RenderPool* pool = calloc(1, sizeof(RenderPool));
+	pool->threads = threads;
+	pool->strips = calloc(threads, sizeof(Strip));
+	pool->workers = calloc(threads, sizeof(pthread_t));
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->start, NULL);
+	pthread_cond_init(&pool->done, NULL);
+	for (int i = 0; i < threads; i++) pool->strips[i].context = render_context_create();
+	pool->spare_context = render_context_create();
+	pool->counts = render_counts_create();
+
+	// There is a thread for every strip, so a frame can be rendered in the background while the caller does something else.
+	// When the caller waits for a frame it picks up strips too, whichever thread gets to a strip first renders it.
+	for (int i = 0; i < threads; i++) pthread_create(&pool->workers[i], NULL, worker_main, pool);
+	return pool;
+}
+
+void render_pool_free(RenderPool* pool) {
+	pthread_mutex_lock(&pool->lock);
+	pool->quit = 1;
+	pthread_cond_broadcast(&pool->start);
+	pthread_mutex_unlock(&pool->lock);
+	for (int i = 0; i < pool->threads; i++) pthread_join(pool->workers[i], NULL);
+
+	for (int i = 0; i < pool->threads; i++) {
+		free(pool->strips[i].y_min);
+		free(pool->strips[i].y_max);
+		render_context_free(pool->strips[i].context);
+	}
+	render_context_free(pool->spare_context);
+	render_counts_free(pool->counts);
+	pthread_mutex_destroy(&pool->lock);
+	pthread_cond_destroy(&pool->start);
+	pthread_cond_destroy(&pool->done);
+	free(pool->strips);
+	free(pool->workers);
+	free(pool);
+}
+
+// Split the screen into equal strips, used when the width changes and there is no cost data.
+void layout_strips_evenly(RenderPool* pool, int w) {
+	for (int i = 0; i < pool->threads; i++) {
+		Strip* strip = &pool->strips[i];
+		strip->x_min = w * i / pool->threads;
+		strip->x_max = w * (i + 1) / pool->threads;
+		strip->cost = 0;
+		free(strip->y_min);
+		free(strip->y_max);
+		strip->y_min = malloc(sizeof(int) * w);
+		strip->y_max = malloc(sizeof(int) * w);
+	}
+	pool->w = w;
+}
+
+// Move the strip boundaries so that every strip should take about the same time.
+// The cost of each strip last frame is assumed to be spread evenly over its columns,
+// and the new boundaries are placed so each strip gets an equal share of the total cost.
+void balance_strips(RenderPool* pool) {
+	int n = pool->threads;
+	double total = 0;
+	for (int i = 0; i < n; i++) total += pool->strips[i].cost;
+	if (total <= 0) return;
+
+	int boundaries[n + 1];
+	boundaries[0] = 0;
+	boundaries[n] = pool->w;
+
+	double accumulated = 0;
+	int next = 1;
+	for (int i = 0; i < n && next < n; i++) {
+		Strip* strip = &pool->strips[i];
+		int width = strip->x_max - strip->x_min;
+		if (width == 0) continue;
+		double per_column = strip->cost / width;
+		for (int x = strip->x_min; x < strip->x_max && next < n; x++) {
+			accumulated += per_column;
+			while (next < n && accumulated >= total * next / n) boundaries[next++] = x + 1;
+		}
+	}
+	while (next < n) boundaries[next++] = pool->w;
+
+	// Only move halfway to the new layout, so a single noisy frame doesn't throw off the balance.
+	for (int i = 1; i < n; i++) {
+		int old = pool->strips[i].x_min;
+		boundaries[i] = (old + boundaries[i] + 1) / 2;
+		boundaries[i] = MAX(boundaries[i], boundaries[i - 1]);
+	}
+
+	for (int i = 0; i < n; i++) {
+		pool->strips[i].x_min = boundaries[i];
+		pool->strips[i].x_max = boundaries[i + 1];
+	}
+}
+
+void render_pool_begin(RenderPool* pool, Canvas* canvas, struct Camera* camera, struct Map* map, int x_min, int x_max) {
+	// Only one frame can be rendered at a time
+	render_pool_wait(pool);
+
+	if (pool->w != canvas->w) {
+		layout_strips_evenly(pool, canvas->w);
+	} else if (x_min == 0 && x_max == canvas->w) {
+		balance_strips(pool);
+	}
+	render_counts_begin_frame(pool->counts, map);
+
+	// Start the workers
+	pthread_mutex_lock(&pool->lock);
+	pool->canvas = canvas;
+	pool->camera = *camera;
+	camera_prepare(&pool->camera);
+	pool->map = map;
+	pool->x_min = x_min;
+	pool->x_max = x_max;
+	pool->views = NULL;
+	pool->jobs = pool->threads;
+	pool->next_job = 0;
+	pool->remaining = pool->jobs;
+	pool->frame_start = seconds();
+	pool->generation++;
+	pthread_cond_broadcast(&pool->start);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+void render_pool_wait(RenderPool* pool) {
+	pthread_mutex_lock(&pool->lock);
+	// Help with any strips that haven't been picked up yet, then wait for the rest to finish
+	render_jobs(pool);
+	while (pool->remaining > 0) pthread_cond_wait(&pool->done, &pool->lock);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+void render_pool_begin_views(RenderPool* pool, RenderView* views, int count, struct Map* map) {
+	render_pool_wait(pool);
+	if (count <= 0) return;
+
+	pthread_mutex_lock(&pool->lock);
+	pool->views = views;
+	pool->map = map;
+	pool->jobs = count;
+	pool->next_job = 0;
+	pool->next_context = 0;
+	pool->remaining = count;
+	pool->frame_start = seconds();
+	pool->generation++;
+	pthread_cond_broadcast(&pool->start);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+void render_pool_views(RenderPool* pool, RenderView* views, int count, struct Map* map) {
+	render_pool_begin_views(pool, views, count, map);
+	render_pool_wait(pool);
+}
+
+void render_frame_threaded_columns(RenderPool* pool, Canvas* canvas, struct Camera* camera, struct Map* map, int x_min, int x_max) {
+	render_pool_begin(pool, canvas, camera, map, x_min, x_max);
+	render_pool_wait(pool);
+}
+
+void render_frame_threaded(RenderPool* pool, Canvas* canvas, struct Camera* camera, struct Map* map) {
+	render_frame_threaded_columns(pool, canvas, camera, map, 0, canvas->w);
+}
+
+int render_pool_threads(RenderPool* pool) {
+	return pool->threads;
+}
+
+RenderContext* render_pool_context(RenderPool* pool, int thread) {
+	return pool->strips[thread].context;
+}
+
+void render_pool_settings(RenderPool* pool, RenderSettings settings) {
+	for (int i = 0; i < pool->threads; i++) render_context_settings(pool->strips[i].context, settings);
+	render_context_settings(pool->spare_context, settings);
+}
+
+double render_pool_frame_time(RenderPool* pool) {
+	return pool->frame_time;
+}
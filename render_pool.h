@@ -0,0 +1,58 @@
+// Multithreaded rendering
+// The screen is split into vertical strips, and each thread runs the portal traversal over its own strip.
+// This works because every column has its own clip bounds, so strips never depend on each other.
+// Batches of whole views can be drawn too, each view is drawn by one thread, for drawing lots of small views at once.
+#pragma once
+
+#include "render.h"
+
+typedef struct RenderPool RenderPool;
+
+// One camera's view of the map, drawn into its own canvas by render_pool_views
+typedef struct RenderView {
+	Canvas* canvas;
+	struct Camera camera;
+	// Set to the counters for this view once it has been drawn
+	RenderStats stats;
+} RenderView;
+
+// Start a pool that splits frames into threads strips, with a worker thread for each.
+RenderPool* render_pool_create(int threads);
+
+// Stop the worker threads and free the pool.
+void render_pool_free(RenderPool* pool);
+
+// Render a whole frame like render_frame, split across the pool.
+// Strip widths are adjusted every frame based on how long each strip took in earlier frames.
+// The pool's contexts have no debug hook, see render_context_debug_hook, so use render_frame with a context of its own to debug the renderer.
+void render_frame_threaded(RenderPool* pool, Canvas* canvas, struct Camera* camera, struct Map* map);
+
+// Render only the columns from x_min to x_max, like render_frame_columns, split across the pool.
+void render_frame_threaded_columns(RenderPool* pool, Canvas* canvas, struct Camera* camera, struct Map* map, int x_min, int x_max);
+
+// Start rendering the columns from x_min to x_max in the background, and return straight away.
+// The camera is copied, so it can be changed, but the canvas and map must be left alone until render_pool_wait returns.
+void render_pool_begin(RenderPool* pool, Canvas* canvas, struct Camera* camera, struct Map* map, int x_min, int x_max);
+
+// Wait for the frame started with render_pool_begin to finish, this returns straight away if there isn't one.
+// The calling thread renders any strips the workers haven't got to yet.
+void render_pool_wait(RenderPool* pool);
+
+// Start drawing count views of the same map in the background, each a whole frame into its own canvas, and return straight away.
+// Views aren't split into strips, each one is drawn by a single thread, so as many views are drawn at once as there are threads.
+// The views and their canvases must be left alone until render_pool_wait returns, and the map must not change.
+void render_pool_begin_views(RenderPool* pool, RenderView* views, int count, struct Map* map);
+
+// Draw count views with render_pool_begin_views, and wait for them all.
+void render_pool_views(RenderPool* pool, RenderView* views, int count, struct Map* map);
+
+// Number of threads in the pool, and the render context each one used for the last frame.
+// After a batch of views the contexts are left with whatever views they drew last, so use the stats in each view instead.
+int render_pool_threads(RenderPool* pool);
+RenderContext* render_pool_context(RenderPool* pool, int thread);
+
+// Change the settings of every context in the pool, the limits apply to each strip on its own.
+void render_pool_settings(RenderPool* pool, RenderSettings settings);
+
+// How long the last finished frame, or batch of views, took to render, in seconds, from when it was started until the last part was done.
+double render_pool_frame_time(RenderPool* pool);
@@ -0,0 +1,147 @@
+// Headless demo playback
+// Plays back a demo recorded in the game (see demo.h), drawing a frame for every tick, and logs a hash of each frame and how long it took to draw.
+// Playback doesn't depend on timing, so the same demo on the same map always gives the same frames.
+// Given the log of an earlier playback, the hashes are checked against it, so a recorded session works as a regression test for output and speed.
+// Textures are replaced with placeholders like in bench, so the results don't depend on image files.
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "map.h"
+#include "render.h"
+#include "render_pool.h"
+#include "texture.h"
+#include "simulation.h"
+#include "demo.h"
+
+double now_ms() {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec * 1000.0 + t.tv_nsec / 1000000.0;
+}
+
+int compare_doubles(const void* a, const void* b) {
+	double x = *(const double*)a, y = *(const double*)b;
+	return (x > y) - (x < y);
+}
+
+// FNV-1a hash of an image
+uint32_t image_hash(uint32_t* pixels, int length) {
+	uint32_t hash = 2166136261u;
+	for (int i = 0; i < length; i++) {
+		hash ^= pixels[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+int main(int argc, char** argv) {
+	if (argc < 3 || argc > 8) {
+		printf("Usage: %s [mapfile] [demo] [width] [height] [threads] [log.csv] [earlier log.csv to check against]\n", argv[0]);
+		return 1;
+	}
+
+	int w = argc > 3 ? atoi(argv[3]) : 640/2;
+	int h = argc > 4 ? atoi(argv[4]) : 480/2;
+	int threads = argc > 5 ? atoi(argv[5]) : 1;
+	if (w < 1 || h < 1 || threads < 1) {
+		printf("Resolution and threads must be positive\n");
+		return 1;
+	}
+	// The hash and time of every frame are written here, if given, - skips it so a log can be checked without writing one
+	FILE* log = NULL;
+	if (argc > 6 && strcmp(argv[6], "-")) {
+		log = fopen(argv[6], "w");
+		if (!log) {
+			printf("Couldn't open %s\n", argv[6]);
+			return 1;
+		}
+		fprintf(log, "frame,ms,hash\n");
+	}
+	FILE* expected = NULL;
+	if (argc > 7) {
+		expected = fopen(argv[7], "r");
+		if (!expected) {
+			printf("Couldn't open %s\n", argv[7]);
+			return 1;
+		}
+		// Skip the header
+		fscanf(expected, "%*[^\n]\n");
+	}
+
+	struct Map* map = load_map(argv[1]);
+	if (!map) return 1;
+	load_map_textures(map, NULL);
+	Demo* demo = demo_load(argv[2]);
+	if (!demo) return 1;
+	if (demo->map_rooms != map->length || demo->start.room_idx < 0 || demo->start.room_idx >= map->length) {
+		printf("The demo was recorded on a diffrent map\n");
+		return 1;
+	}
+
+	Canvas* canvas = canvas_allocate(w, h);
+	RenderPool* pool = threads > 1 ? render_pool_create(threads) : NULL;
+	RenderContext* context = render_context_create();
+	Simulation sim = simulation_create(demo->start, demo->tick_rate);
+
+	unsigned long frames = demo_ticks(demo);
+	double* times = malloc(sizeof(double) * (frames ? frames : 1));
+	double total = 0;
+	uint32_t hash = 2166136261u;
+	long first_mismatch = -1;
+	unsigned long frame = 0;
+	for (int run = 0; run < demo->run_count; run++) {
+		PlayerInput input = player_input(demo->runs[run] & 0xff);
+		for (unsigned long tick = 0; tick < demo->runs[run] >> 8; tick++, frame++) {
+			// Every tick is drawn as it is, there's nothing to interpolate with a frame for each one
+			simulation_tick(&sim, map, input);
+			double start = now_ms();
+			if (pool) render_frame_threaded(pool, canvas, &sim.current, map);
+			else render_frame(context, canvas, &sim.current, map);
+			times[frame] = now_ms() - start;
+			total += times[frame];
+
+			uint32_t frame_hash = image_hash(canvas->pixels, w * h);
+			hash = (hash ^ frame_hash) * 16777619u;
+			if (log) fprintf(log, "%lu,%.4f,%08x\n", frame, times[frame], frame_hash);
+			if (expected && first_mismatch == -1) {
+				unsigned long expected_frame;
+				uint32_t expected_hash;
+				if (fscanf(expected, "%lu,%*f,%x\n", &expected_frame, &expected_hash) != 2 || expected_frame != frame || expected_hash != frame_hash)
+					first_mismatch = frame;
+			}
+		}
+	}
+
+	// An earlier log with more frames doesn't match either
+	if (expected && first_mismatch == -1 && fgetc(expected) != EOF) first_mismatch = frames;
+
+	printf("map:      %s\n", argv[1]);
+	printf("demo:     %s, %lu ticks at %.1f per second\n", argv[2], frames, demo->tick_rate);
+	printf("numeric:  %s\n", render_numeric());
+	printf("frames:   %lu at %dx%d, %d threads\n", frames, w, h, threads);
+	if (frames) {
+		qsort(times, frames, sizeof(double), compare_doubles);
+		printf("min:      %.4f ms\n", times[0]);
+		printf("median:   %.4f ms\n", times[frames / 2]);
+		printf("p99:      %.4f ms\n", times[(unsigned long)(frames * 0.99)]);
+		printf("max:      %.4f ms\n", times[frames - 1]);
+		printf("fps:      %.1f\n", frames / (total / 1000.0));
+	}
+	printf("checksum: %08x\n", hash);
+	if (expected) {
+		if (first_mismatch == -1) printf("matches:  %s\n", argv[7]);
+		else printf("differs:  from %s at frame %ld\n", argv[7], first_mismatch);
+		fclose(expected);
+	}
+
+	if (log) fclose(log);
+	free(times);
+	if (pool) render_pool_free(pool);
+	render_context_free(context);
+	canvas_free(canvas);
+	demo_free(demo);
+	free_map(map);
+	return first_mismatch == -1 ? 0 : 1;
+}
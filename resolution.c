@@ -0,0 +1,33 @@
+// Dynamic resolution, see resolution.h
+#include <math.h>
+#include "resolution.h"
+#include "math.h"
+
+ResolutionScaler resolution_scaler(double target, double min_scale) {
+	return (ResolutionScaler) {.target = target, .scale = 1, .min_scale = min_scale};
+}
+
+int resolution_update(ResolutionScaler* scaler, double frame_time) {
+	scaler->total += frame_time;
+	if (++scaler->frames < RESOLUTION_FRAMES) return 0;
+	double average = scaler->total / scaler->frames;
+	scaler->total = 0;
+	scaler->frames = 0;
+
+	// Within 10% of the target is close enough, so the resolution doesn't keep flickering between two sizes
+	double ratio = scaler->target / MAX(average, 1e-6);
+	if (ratio > 0.9 && ratio < 1.1) return 0;
+
+	// Drop quickly when frames are too slow, but grow slowly, since growing too far costs a slow frame
+	double scale = scaler->scale * sqrt(ratio);
+	scale = MIN(MAX(scale, scaler->scale * 0.7), scaler->scale * 1.1);
+	scale = MIN(MAX(scale, scaler->min_scale), 1);
+	if (fabs(scale - scaler->scale) < 0.01) return 0;
+	scaler->scale = scale;
+	return 1;
+}
+
+void resolution_size(ResolutionScaler* scaler, int w, int h, int* scaled_w, int* scaled_h) {
+	*scaled_w = MAX((int)(w * scaler->scale), 1);
+	*scaled_h = MAX((int)(h * scaler->scale), 1);
+}
@@ -0,0 +1,27 @@
+// Dynamic resolution
+// Picks how much of the window's resolution to render at, so frames take about as long as a target time.
+// Render time is roughly proportional to the number of pixels, so each side is scaled by the square root of how far off the time was.
+#pragma once
+
+// Frames averaged before the scale is changed
+#define RESOLUTION_FRAMES 8
+
+typedef struct ResolutionScaler {
+	// Frame time to aim for, in seconds
+	double target;
+	// Fraction of the window's width and height rendered, from min_scale to 1
+	double scale, min_scale;
+	// Frame times added up since the scale was last looked at
+	double total;
+	int frames;
+} ResolutionScaler;
+
+// Make a scaler that starts at full resolution
+ResolutionScaler resolution_scaler(double target, double min_scale);
+
+// Add how long a whole frame took to render, in seconds.
+// Every RESOLUTION_FRAMES frames the scale is moved towards the target, returns 1 if it changed.
+int resolution_update(ResolutionScaler* scaler, double frame_time);
+
+// Find the size to render at, for a window w by h pixels
+void resolution_size(ResolutionScaler* scaler, int w, int h, int* scaled_w, int* scaled_h);
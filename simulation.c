@@ -0,0 +1,58 @@
+// Fixed timestep simulation, see simulation.h
+#include "simulation.h"
+#include "grid.h"
+
+PlayerInput player_input(int keys) {
+	PlayerInput input = {{0, 0}, 0};
+	if (keys & KEY_TURN_LEFT) input.turn -= TURN_SPEED;
+	if (keys & KEY_TURN_RIGHT) input.turn += TURN_SPEED;
+	// The camera is facing y+.
+	if (keys & KEY_FORWARD) input.move.y += MOVE_SPEED;
+	if (keys & KEY_BACK) input.move.y -= MOVE_SPEED;
+	if (keys & KEY_LEFT) input.move.x -= MOVE_SPEED;
+	if (keys & KEY_RIGHT) input.move.x += MOVE_SPEED;
+	return input;
+}
+
+Simulation simulation_create(struct Camera camera, double tick_rate) {
+	return (Simulation) {.tick = 1 / tick_rate, .previous = camera, .current = camera};
+}
+
+void simulation_tick(Simulation* sim, struct Map* map, PlayerInput input) {
+	sim->previous = sim->current;
+	sim->current.angle += input.turn * sim->tick;
+	move_camera(map, &sim->current, (Point2) {input.move.x * sim->tick, input.move.y * sim->tick});
+	sim->ticks++;
+}
+
+int simulation_update(Simulation* sim, struct Map* map, PlayerInput input, double seconds) {
+	sim->pending += seconds;
+	int ticks = 0;
+	while (sim->pending >= sim->tick) {
+		if (ticks == SIMULATION_MAX_TICKS) {
+			sim->pending = 0;
+			break;
+		}
+		simulation_tick(sim, map, input);
+		sim->pending -= sim->tick;
+		ticks++;
+	}
+	return ticks;
+}
+
+struct Camera simulation_camera(Simulation* sim, struct Map* map) {
+	struct Camera* a = &sim->previous;
+	struct Camera* b = &sim->current;
+	float t = sim->pending / sim->tick;
+	// Lerping like this gives exactly the same camera when nothing moved, so stopped frames aren't drawn again
+	struct Camera camera = *b;
+	camera.location.x = a->location.x + (b->location.x - a->location.x) * t;
+	camera.location.y = a->location.y + (b->location.y - a->location.y) * t;
+	camera.z = a->z + (b->z - a->z) * t;
+	camera.angle = a->angle + (b->angle - a->angle) * t;
+
+	// The tick went through portals, so find how many of them the location has got through yet.
+	// A fast tick can cross more than one, so the path is followed from room to room.
+	if (a->room_idx != b->room_idx) camera.room_idx = map_trace(map, a->room_idx, a->location, camera.location);
+	return camera;
+}
@@ -0,0 +1,61 @@
+// Fixed timestep simulation
+// The camera is moved in ticks of a fixed length, however often frames are drawn, so movement speed doesn't depend on the frame rate.
+// Frames show the camera interpolated between the last two ticks, so motion stays smooth when frames and ticks don't line up.
+// A slow frame just means more ticks are run before the next one, the simulation doesn't slow down with it.
+#pragma once
+
+#include "map.h"
+
+// At most this many ticks are run at once, any more time than that is dropped.
+// Otherwise a long stall would be followed by a burst of ticks, which could take long enough to cause another one.
+#define SIMULATION_MAX_TICKS 8
+
+// What the player is doing, as speeds per second
+typedef struct PlayerInput {
+	// Movement in camera space, +y is forward
+	Point2 move;
+	// Turning, in radians
+	float turn;
+} PlayerInput;
+
+// Speeds the camera moves and turns at while a key is held, per second
+#define MOVE_SPEED 6
+#define TURN_SPEED 3
+
+// Keys the player can hold down, as bits
+enum PlayerKey {
+	KEY_FORWARD = 1,
+	KEY_BACK = 2,
+	KEY_LEFT = 4,
+	KEY_RIGHT = 8,
+	KEY_TURN_LEFT = 16,
+	KEY_TURN_RIGHT = 32,
+};
+
+// The input for a set of PlayerKey bits held down.
+// Input is always made from keys, so ticks can be recorded as the keys alone and played back exactly, see demo.h
+PlayerInput player_input(int keys);
+
+typedef struct Simulation {
+	// Length of a tick, in seconds
+	double tick;
+	// Time that has passed but hasn't been simulated yet, always less than a tick after simulation_update
+	double pending;
+	// The camera after the last two ticks
+	struct Camera previous, current;
+	// Ticks run so far
+	unsigned long ticks;
+} Simulation;
+
+// Start a simulation running tick_rate ticks a second, with the camera where it is.
+Simulation simulation_create(struct Camera camera, double tick_rate);
+
+// Run one tick, moving the camera by the input over the length of a tick.
+void simulation_tick(Simulation* sim, struct Map* map, PlayerInput input);
+
+// Add seconds of time, and run every tick that is due with the same input. Returns the number of ticks run.
+int simulation_update(Simulation* sim, struct Map* map, PlayerInput input, double seconds);
+
+// The camera to draw, between the last two ticks by how far the pending time is into the next one.
+// If the last tick moved through portals, the room is the one the in between location got to, following its path through them.
+struct Camera simulation_camera(Simulation* sim, struct Map* map);
@@ -0,0 +1,94 @@
+// Renderer statistics, see stats.h
+#include <ctype.h>
+#include "stats.h"
+
+const char* stats_primitive_names[RENDER_PRIMITIVES] = {"walls", "steps", "flats", "planes", "fills", "sprites"};
+
+void stats_add(RenderStats* total, RenderStats* stats) {
+	total->rooms += stats->rooms;
+	total->max_depth = MAX(total->max_depth, stats->max_depth);
+	total->portals += stats->portals;
+	total->walls_tested += stats->walls_tested;
+	total->walls_drawn += stats->walls_drawn;
+	total->walls_clipped += stats->walls_clipped;
+	total->sprites += stats->sprites;
+	for (int i = 0; i < RENDER_PRIMITIVES; i++) total->pixels[i] += stats->pixels[i];
+}
+
+RenderStats stats_sum(RenderContext** contexts, int count) {
+	RenderStats total = {0};
+	for (int i = 0; i < count; i++) stats_add(&total, render_context_stats(contexts[i]));
+	return total;
+}
+
+void stats_csv_header(FILE* file) {
+	fprintf(file, "frame,ms,rooms,max_depth,portals,walls_tested,walls_drawn,walls_clipped,sprites");
+	for (int i = 0; i < RENDER_PRIMITIVES; i++) fprintf(file, ",pixels_%s", stats_primitive_names[i]);
+	fprintf(file, "\n");
+}
+
+void stats_csv_row(FILE* file, int frame, double ms, RenderStats* stats) {
+	fprintf(
+		file, "%d,%.4f,%d,%d,%d,%d,%d,%d,%d", frame, ms, stats->rooms, stats->max_depth, stats->portals,
+		stats->walls_tested, stats->walls_drawn, stats->walls_clipped, stats->sprites
+	);
+	for (int i = 0; i < RENDER_PRIMITIVES; i++) fprintf(file, ",%ld", stats->pixels[i]);
+	fprintf(file, "\n");
+}
+
+//////////
+// Font //
+//////////
+
+// Every character is 3 by 5 pixels, written out row by row
+struct Glyph {
+	char c;
+	const char* rows;
+};
+
+const struct Glyph font[] = {
+	{'0', "111101101101111"}, {'1', "010110010010111"}, {'2', "111001111100111"}, {'3', "111001111001111"},
+	{'4', "101101111001001"}, {'5', "111100111001111"}, {'6', "111100111101111"}, {'7', "111001001001001"},
+	{'8', "111101111101111"}, {'9', "111101111001111"}, {'A', "010101111101101"}, {'B', "110101110101110"},
+	{'C', "011100100100011"}, {'D', "110101101101110"}, {'E', "111100110100111"}, {'F', "111100110100100"},
+	{'G', "011100101101011"}, {'H', "101101111101101"}, {'I', "111010010010111"}, {'J', "001001001101010"},
+	{'K', "101101110101101"}, {'L', "100100100100111"}, {'M', "101111111101101"}, {'N', "110101101101101"},
+	{'O', "010101101101010"}, {'P', "110101110100100"}, {'Q', "010101101110011"}, {'R', "110101110101101"},
+	{'S', "011100010001110"}, {'T', "111010010010010"}, {'U', "101101101101111"}, {'V', "101101101101010"},
+	{'W', "101101111111101"}, {'X', "101101010101101"}, {'Y', "101101010010010"}, {'Z', "111001010100111"},
+	{':', "000010000010000"}, {'.', "000000000000010"}, {'/', "001001010100100"}, {'-', "000000111000000"},
+};
+
+void draw_text(Canvas* canvas, int x, int y, const char* text, uint32_t color) {
+	for (; *text; text++, x += 4) {
+		const char* rows = "000000000000000";
+		for (int i = 0; i < (int)(sizeof(font) / sizeof(font[0])); i++)
+			if (font[i].c == toupper(*text)) rows = font[i].rows;
+
+		// Draw the character cell, with a black background so it can be read over anything
+		for (int cx = 0; cx < 4; cx++) {
+			if (x + cx < 0 || x + cx >= canvas->w) continue;
+			uint32_t* column = canvas_column(canvas, x + cx);
+			for (int cy = 0; cy < 6; cy++) {
+				if (y + cy < 0 || y + cy >= canvas->h) continue;
+				int lit = cx < 3 && cy < 5 && rows[cy * 3 + cx] == '1';
+				column[y + cy] = lit ? color : 0x000000ff;
+			}
+		}
+	}
+}
+
+void stats_draw(Canvas* canvas, RenderStats* stats, double ms) {
+	char line[128];
+	int y = 0;
+	snprintf(line, sizeof(line), " %.2f ms ", ms);
+	draw_text(canvas, 0, y, line, 0xffffffff);
+	snprintf(line, sizeof(line), " rooms %d depth %d portals %d ", stats->rooms, stats->max_depth, stats->portals);
+	draw_text(canvas, 0, y += 6, line, 0xffffffff);
+	snprintf(line, sizeof(line), " walls %d drawn %d clipped %d sprites %d ", stats->walls_tested, stats->walls_drawn, stats->walls_clipped, stats->sprites);
+	draw_text(canvas, 0, y += 6, line, 0xffffffff);
+	for (int i = 0; i < RENDER_PRIMITIVES; i++) {
+		snprintf(line, sizeof(line), " %s %ld ", stats_primitive_names[i], stats->pixels[i]);
+		draw_text(canvas, 0, y += 6, line, 0xffff00ff);
+	}
+}
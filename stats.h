@@ -0,0 +1,26 @@
+// Renderer statistics
+// Adds up the counters from render contexts, writes them to CSV files, and draws them over the frame with a tiny built in font.
+#pragma once
+
+#include <stdio.h>
+#include "render.h"
+
+// Short names for each primitive, used in labels and CSV headers
+extern const char* stats_primitive_names[RENDER_PRIMITIVES];
+
+// Add the counters in stats to total, for max_depth the larger one is kept.
+void stats_add(RenderStats* total, RenderStats* stats);
+
+// Add up the counters from a list of contexts, such as every context in a render pool.
+RenderStats stats_sum(RenderContext** contexts, int count);
+
+// Write the CSV header, and a line for one frame that took ms to draw.
+void stats_csv_header(FILE* file);
+void stats_csv_row(FILE* file, int frame, double ms, RenderStats* stats);
+
+// Draw text with its top left corner at x, y, each character is 4 by 6 pixels.
+// Only letters, numbers, spaces, and : . / - can be drawn, anything else is left blank.
+void draw_text(Canvas* canvas, int x, int y, const char* text, uint32_t color);
+
+// Draw the counters, and the time taken to draw the frame, over the top left of the canvas.
+void stats_draw(Canvas* canvas, RenderStats* stats, double ms);
@@ -0,0 +1,248 @@
+// World streaming, see stream.h
+#include <stdlib.h>
+#include <pthread.h>
+#include "stream.h"
+
+enum RoomState {
+	// Not loaded and not asked for
+	ROOM_MISSING,
+	// Waiting in the request list
+	ROOM_QUEUED,
+	// Being read by the loading thread
+	ROOM_LOADING,
+	// Read, and waiting for stream_update to put it in the map
+	ROOM_READY,
+	ROOM_LOADED,
+	// Couldn't be read, it is left missing
+	ROOM_FAILED,
+};
+
+struct WorldStream {
+	struct Map* map;
+	struct MapIndex index;
+	size_t memory_cap, bytes;
+	int hops;
+	int loaded_count;
+
+	// Loaded rooms from most to least recently used, as a linked list through each room's neighbours
+	int* lru_prev;
+	int* lru_next;
+	int lru_head, lru_tail;
+	// The update each room was last near the camera in, those rooms are never freed
+	unsigned long* used;
+	unsigned long update;
+
+	// Scratch for finding the rooms near the camera, rooms in the order they are found and how many hops away they are
+	int* found;
+	int* found_hops;
+	unsigned long* found_update;
+
+	// Shared with the loading thread, only used with lock held
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+	enum RoomState* state;
+	// Rooms to load, closest first, taken from requests_head onwards
+	int* requests;
+	int requests_head, requests_count;
+	// Rooms read since the last update, and what was read for each room
+	int* ready;
+	int ready_count;
+	struct Room** read;
+	int quit;
+};
+
+void* stream_thread(void* data) {
+	WorldStream* stream = data;
+	pthread_mutex_lock(&stream->lock);
+	while (1) {
+		while (!stream->quit && stream->requests_head == stream->requests_count) pthread_cond_wait(&stream->wake, &stream->lock);
+		if (stream->quit) break;
+		int roomid = stream->requests[stream->requests_head++];
+		stream->state[roomid] = ROOM_LOADING;
+
+		// Read without the lock, so stream_update never waits for the disk
+		pthread_mutex_unlock(&stream->lock);
+		struct Room* room = load_map_room(&stream->index, roomid, stream->map->length);
+		pthread_mutex_lock(&stream->lock);
+
+		stream->read[roomid] = room;
+		stream->state[roomid] = ROOM_READY;
+		stream->ready[stream->ready_count++] = roomid;
+	}
+	pthread_mutex_unlock(&stream->lock);
+	return NULL;
+}
+
+// Take a room out of the least recently used list, if it is in it
+void lru_unlink(WorldStream* stream, int roomid) {
+	int prev = stream->lru_prev[roomid], next = stream->lru_next[roomid];
+	if (prev != -1) stream->lru_next[prev] = next;
+	else if (stream->lru_head == roomid) stream->lru_head = next;
+	if (next != -1) stream->lru_prev[next] = prev;
+	else if (stream->lru_tail == roomid) stream->lru_tail = prev;
+	stream->lru_prev[roomid] = stream->lru_next[roomid] = -1;
+}
+
+// Move a loaded room to the front of the least recently used list, adding it if it isn't in it
+void lru_touch(WorldStream* stream, int roomid) {
+	lru_unlink(stream, roomid);
+	stream->lru_next[roomid] = stream->lru_head;
+	if (stream->lru_head != -1) stream->lru_prev[stream->lru_head] = roomid;
+	stream->lru_head = roomid;
+	if (stream->lru_tail == -1) stream->lru_tail = roomid;
+}
+
+// Put a room that has been read into the map
+void install_room(WorldStream* stream, int roomid, struct Room* room) {
+	struct Map* map = stream->map;
+	map->rooms[roomid] = room;
+	stream->state[roomid] = ROOM_LOADED;
+	stream->bytes += room_size(room);
+	stream->loaded_count++;
+	lru_touch(stream, roomid);
+	map_room_replaced(map, roomid);
+}
+
+// Free a loaded room, and put it back to missing
+void evict_room(WorldStream* stream, int roomid) {
+	struct Map* map = stream->map;
+	// Its packed walls are what tell map_room_replaced which rooms had steps up to it
+	map_pack_walls(map, roomid);
+	stream->bytes -= room_size(map->rooms[roomid]);
+	stream->loaded_count--;
+	free_room(map->rooms[roomid]);
+	map->rooms[roomid] = &map_missing_room;
+	stream->state[roomid] = ROOM_MISSING;
+	lru_unlink(stream, roomid);
+	map_room_replaced(map, roomid);
+}
+
+WorldStream* stream_open(const char* path, size_t memory_cap, int hops) {
+	WorldStream* stream = calloc(1, sizeof(WorldStream));
+	stream->map = load_map_index(path, &stream->index);
+	if (!stream->map) {
+		free(stream);
+		return NULL;
+	}
+	int length = stream->map->length ? stream->map->length : 1;
+	stream->memory_cap = memory_cap;
+	stream->hops = hops;
+	stream->lru_prev = malloc(sizeof(int) * length);
+	stream->lru_next = malloc(sizeof(int) * length);
+	for (int i = 0; i < length; i++) stream->lru_prev[i] = stream->lru_next[i] = -1;
+	stream->lru_head = stream->lru_tail = -1;
+	stream->used = calloc(length, sizeof(unsigned long));
+	stream->found = malloc(sizeof(int) * length);
+	stream->found_hops = malloc(sizeof(int) * length);
+	stream->found_update = calloc(length, sizeof(unsigned long));
+	stream->state = calloc(length, sizeof(enum RoomState));
+	stream->requests = malloc(sizeof(int) * length);
+	stream->ready = malloc(sizeof(int) * length);
+	stream->read = calloc(length, sizeof(struct Room*));
+
+	// The camera starts in the starting room, so it is loaded straight away
+	if (stream->map->length > 0) {
+		int start = stream->map->starting_room;
+		struct Room* room = load_map_room(&stream->index, start, stream->map->length);
+		if (room) install_room(stream, start, room);
+		else stream->state[start] = ROOM_FAILED;
+	}
+
+	pthread_mutex_init(&stream->lock, NULL);
+	pthread_cond_init(&stream->wake, NULL);
+	pthread_create(&stream->thread, NULL, stream_thread, stream);
+	return stream;
+}
+
+void stream_close(WorldStream* stream) {
+	pthread_mutex_lock(&stream->lock);
+	stream->quit = 1;
+	pthread_cond_broadcast(&stream->wake);
+	pthread_mutex_unlock(&stream->lock);
+	pthread_join(stream->thread, NULL);
+	pthread_mutex_destroy(&stream->lock);
+	pthread_cond_destroy(&stream->wake);
+
+	// Rooms that were read but never put in the map
+	for (int i = 0; i < stream->ready_count; i++) free_room(stream->read[stream->ready[i]]);
+	free_map_index(&stream->index);
+	free_map(stream->map);
+	free(stream->lru_prev);
+	free(stream->lru_next);
+	free(stream->used);
+	free(stream->found);
+	free(stream->found_hops);
+	free(stream->found_update);
+	free(stream->state);
+	free(stream->requests);
+	free(stream->ready);
+	free(stream->read);
+	free(stream);
+}
+
+struct Map* stream_map(WorldStream* stream) {
+	return stream->map;
+}
+
+void stream_update(WorldStream* stream, struct Camera* camera) {
+	struct Map* map = stream->map;
+	if (map->length == 0) return;
+	stream->update++;
+	pthread_mutex_lock(&stream->lock);
+
+	// Put in the rooms that finished loading
+	for (int i = 0; i < stream->ready_count; i++) {
+		int roomid = stream->ready[i];
+		if (stream->read[roomid]) install_room(stream, roomid, stream->read[roomid]);
+		else stream->state[roomid] = ROOM_FAILED;
+		stream->read[roomid] = NULL;
+	}
+	stream->ready_count = 0;
+
+	// Forget the old requests, the camera may have moved away from them
+	for (int i = stream->requests_head; i < stream->requests_count; i++) stream->state[stream->requests[i]] = ROOM_MISSING;
+	stream->requests_head = stream->requests_count = 0;
+
+	// Walk out through portals from the camera's room, breadth first so rooms are found closest first.
+	// Portals are only known for loaded rooms, so the walk stops at missing ones, and goes further as they load.
+	int found_count = 0;
+	stream->found[found_count++] = camera->room_idx;
+	stream->found_hops[camera->room_idx] = 0;
+	stream->found_update[camera->room_idx] = stream->update;
+	for (int i = 0; i < found_count; i++) {
+		int roomid = stream->found[i];
+		stream->used[roomid] = stream->update;
+		if (stream->state[roomid] == ROOM_MISSING) {
+			stream->state[roomid] = ROOM_QUEUED;
+			stream->requests[stream->requests_count++] = roomid;
+		}
+		if (stream->state[roomid] != ROOM_LOADED) continue;
+		lru_touch(stream, roomid);
+		if (stream->found_hops[roomid] == stream->hops) continue;
+
+		struct Room* room = map->rooms[roomid];
+		for (int j = 0; j < room->length; j++) {
+			int portal = room->walls[j].portal_idx;
+			if (portal == -1 || stream->found_update[portal] == stream->update) continue;
+			stream->found_update[portal] = stream->update;
+			stream->found_hops[portal] = stream->found_hops[roomid] + 1;
+			stream->found[found_count++] = portal;
+		}
+	}
+	if (stream->requests_count > 0) pthread_cond_signal(&stream->wake);
+
+	// Free the least recently used rooms until they fit, stopping at rooms near the camera, since everything after them is too
+	while (stream->bytes > stream->memory_cap && stream->lru_tail != -1 && stream->used[stream->lru_tail] != stream->update)
+		evict_room(stream, stream->lru_tail);
+
+	pthread_mutex_unlock(&stream->lock);
+}
+
+StreamStats stream_stats(WorldStream* stream) {
+	pthread_mutex_lock(&stream->lock);
+	StreamStats stats = {stream->loaded_count, stream->bytes, stream->requests_count - stream->requests_head};
+	for (int i = 0; i < stream->map->length; i++) stats.pending += stream->state[i] == ROOM_LOADING;
+	pthread_mutex_unlock(&stream->lock);
+	return stats;
+}
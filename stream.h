@@ -0,0 +1,38 @@
+// World streaming
+// For maps too big to keep in memory, rooms are loaded from a binary map file as the camera gets near them, and dropped when memory runs short.
+// Rooms within a number of portal hops of the camera's room are wanted, and missing ones are read by a background thread, closest first.
+// Until a room is loaded it is map_missing_room, which the renderer draws as a placeholder, so drawing never waits for the disk.
+// The camera stops at portals to missing rooms like at walls, a missing room has no walls to keep it in.
+// Loaded rooms are kept in least recently used order, and the ones used longest ago are freed when the loaded rooms go over the memory cap.
+#pragma once
+
+#include <stddef.h>
+#include "map.h"
+
+typedef struct WorldStream WorldStream;
+
+typedef struct StreamStats {
+	// Rooms loaded, and the memory they use in bytes
+	int rooms;
+	size_t bytes;
+	// Rooms waiting to be loaded, or being loaded
+	int pending;
+} StreamStats;
+
+// Open a binary map file for streaming, returns NULL if it can't be opened.
+// Loaded rooms are kept under memory_cap bytes, unless the rooms within hops of the camera need more than that.
+// The starting room is loaded before this returns, so a camera can be placed in it.
+WorldStream* stream_open(const char* path, size_t memory_cap, int hops);
+
+// Stop the loading thread, and free the stream and its map.
+void stream_close(WorldStream* stream);
+
+// The map being streamed, its rooms change in stream_update.
+struct Map* stream_map(WorldStream* stream);
+
+// Put rooms that finished loading into the map, ask for the rooms near the camera, and free rooms over the memory cap.
+// Rooms that come in or go out are marked with map_room_replaced, so redraw tracking picks them up, and the map's packed walls and grid are updated for just those rooms.
+// Nothing may be drawing the map while this runs, so call it between frames.
+void stream_update(WorldStream* stream, struct Camera* camera);
+
+StreamStats stream_stats(WorldStream* stream);
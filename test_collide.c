@@ -0,0 +1,99 @@
+// Collision tests
+// Walls lying on the x = 0 or y = 0 lines hit at exactly 0, which once wasn't counted as a hit, letting the camera walk out of maps that start at the origin.
+// The camera drawn between ticks has to end up in the right room even if the tick crossed more than one portal.
+// Returns non zero if a test fails. Run it with ./test_collide after building.
+#include <stdio.h>
+#include <stdlib.h>
+#include "map.h"
+#include "grid.h"
+#include "simulation.h"
+
+int failures = 0;
+
+void check(int ok, const char* what) {
+	printf("%s: %s\n", ok ? "ok  " : "FAIL", what);
+	if (!ok) failures++;
+}
+
+int main() {
+	// A 2x2 room with its corner on the origin, walls on both axes
+	struct Map* map = allocate_map(1);
+	struct Room* room = map->rooms[0] = allocate_room(4);
+	Point2 corners[4] = {{0, 0}, {0, 2}, {2, 2}, {2, 0}};
+	for (int i = 0; i < 4; i++) room->walls[i] = (struct WallVertex) {.location = corners[i], .texture = -1, .portal_idx = -1};
+	room->z0 = 0;
+	room->z1 = 2;
+	map->starting_location = (Point2) {1, 1};
+	map->starting_room = 0;
+	map_changed(map);
+
+	Point2 hit;
+	check(room_collide(room, (Point2) {1, 1}, (Point2) {-1, 1}, &hit) == 0 && hit.x == 0, "room_collide hits the wall on x = 0");
+	check(room_collide(room, (Point2) {1, 1}, (Point2) {1, -1}, &hit) == 3 && hit.y == 0, "room_collide hits the wall on y = 0");
+	check(map_collide(map, 0, (Point2) {1, 1}, (Point2) {-1, 1}, &hit) == 0 && hit.x == 0, "map_collide hits the wall on x = 0");
+	check(map_collide(map, 0, (Point2) {1, 1}, (Point2) {1, -1}, &hit) == 3 && hit.y == 0, "map_collide hits the wall on y = 0");
+	check(map_collide(map, 0, (Point2) {0.5, 0.5}, (Point2) {1.5, 1.5}, NULL) == -1, "map_collide misses inside the room");
+
+	// Walk into each wall on the axes, the camera has to stay in the room
+	struct Camera camera;
+	place_camera(map, &camera, (Point2) {1, 1}, 0);
+	camera.angle = 0;
+	for (int i = 0; i < 10; i++) move_camera(map, &camera, (Point2) {-0.5, 0});
+	check(camera.location.x > 0 && camera.room_idx == 0, "move_camera stops at the wall on x = 0");
+	for (int i = 0; i < 10; i++) move_camera(map, &camera, (Point2) {0, -0.5});
+	check(camera.location.y > 0 && camera.room_idx == 0, "move_camera stops at the wall on y = 0");
+
+	free_map(map);
+
+	// Two rooms side by side, x = 0 to 2 and 2 to 4, with the second not streamed in yet
+	map = allocate_map(2);
+	room = map->rooms[0] = allocate_room(4);
+	for (int i = 0; i < 4; i++) room->walls[i] = (struct WallVertex) {.location = corners[i], .texture = -1, .portal_idx = i == 2 ? 1 : -1};
+	room->z0 = 0;
+	room->z1 = 2;
+	map->rooms[1] = &map_missing_room;
+	map_changed(map);
+	place_camera(map, &camera, (Point2) {1, 1}, 0);
+	camera.angle = 0;
+	for (int i = 0; i < 10; i++) move_camera(map, &camera, (Point2) {0.5, 0});
+	check(camera.location.x < 2 && camera.room_idx == 0, "move_camera stops at a portal to a missing room");
+
+	// Once it is in, the portal can be walked through
+	struct Room* other = map->rooms[1] = allocate_room(4);
+	Point2 other_corners[4] = {{2, 0}, {2, 2}, {4, 2}, {4, 0}};
+	for (int i = 0; i < 4; i++) other->walls[i] = (struct WallVertex) {.location = other_corners[i], .texture = -1, .portal_idx = i == 0 ? 0 : -1};
+	other->z0 = 0;
+	other->z1 = 2;
+	map_room_changed(map, 1, 1);
+	for (int i = 0; i < 2; i++) move_camera(map, &camera, (Point2) {0.3, 0});
+	check(camera.location.x > 2 && camera.room_idx == 1, "move_camera goes through the portal once the room is in");
+	free_map(map);
+
+	// Three rooms in a row, x = 0 to 2, 2 to 4 and 4 to 6, and a tick going from the first to the last
+	map = allocate_map(3);
+	for (int i = 0; i < 3; i++) {
+		room = map->rooms[i] = allocate_room(4);
+		for (int j = 0; j < 4; j++) {
+			int portal = j == 0 && i > 0 ? i - 1 : j == 2 && i < 2 ? i + 1 : -1;
+			room->walls[j] = (struct WallVertex) {.location = {corners[j].x + i * 2, corners[j].y}, .texture = -1, .portal_idx = portal};
+		}
+		room->z0 = 0;
+		room->z1 = 2;
+	}
+	map_changed(map);
+	struct Camera start, end;
+	place_camera(map, &start, (Point2) {1, 1}, 0);
+	place_camera(map, &end, (Point2) {5, 1}, 2);
+	Simulation sim = simulation_create(start, 1);
+	sim.previous = start;
+	sim.current = end;
+	sim.pending = 0.5;
+	check(simulation_camera(&sim, map).room_idx == 1, "simulation_camera finds the middle room halfway through a tick across two portals");
+	sim.pending = 0.9;
+	check(simulation_camera(&sim, map).room_idx == 2, "simulation_camera follows a tick through two portals");
+	sim.pending = 0.1;
+	check(simulation_camera(&sim, map).room_idx == 0, "simulation_camera stays in the first room before the portals");
+	free_map(map);
+
+	return failures != 0;
+}
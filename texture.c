@@ -0,0 +1,198 @@
+// Textures, see texture.h
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "texture.h"
+#include "light.h"
+
+TextureAtlas* texture_atlas_create() {
+	return calloc(1, sizeof(TextureAtlas));
+}
+
+void texture_atlas_free(TextureAtlas* atlas) {
+	if (!atlas) return;
+	free(atlas->pixels);
+	free(atlas->textures);
+	free(atlas);
+}
+
+// Smallest power of two that is at least n, as a power
+int log2_ceil(int n) {
+	int power = 0;
+	while ((1 << power) < n && power < TEXTURE_MAX_LOG2) power++;
+	return power;
+}
+
+// Average 4 RGBA8888 pixels, channel by channel
+uint32_t average_pixels(uint32_t a, uint32_t b, uint32_t c, uint32_t d) {
+	uint32_t result = 0;
+	for (int shift = 0; shift < 32; shift += 8) {
+		uint32_t sum = (a >> shift & 0xff) + (b >> shift & 0xff) + (c >> shift & 0xff) + (d >> shift & 0xff);
+		result |= (sum + 2) / 4 << shift;
+	}
+	return result;
+}
+
+int texture_atlas_add(TextureAtlas* atlas, const uint32_t* pixels, int w, int h) {
+	struct Texture texture;
+	texture.w_log2 = log2_ceil(w);
+	texture.h_log2 = log2_ceil(h);
+	texture.levels = MAX(texture.w_log2, texture.h_log2) + 1;
+
+	// Find where every level goes
+	size_t size = 0;
+	for (int level = 0; level < texture.levels; level++) {
+		texture.offset[level] = atlas->length + size;
+		size += (size_t)1 << (MAX(texture.w_log2 - level, 0) + MAX(texture.h_log2 - level, 0));
+	}
+	atlas->pixels = realloc(atlas->pixels, sizeof(uint32_t) * (atlas->length + size));
+	atlas->textures = realloc(atlas->textures, sizeof(struct Texture) * (atlas->count + 1));
+
+	// Level 0 is the image scaled to a power of two, and transposed to be column by column
+	int level_w = 1 << texture.w_log2, level_h = 1 << texture.h_log2;
+	uint32_t* level0 = &atlas->pixels[texture.offset[0]];
+	for (int x = 0; x < level_w; x++)
+		for (int y = 0; y < level_h; y++)
+			level0[y + x * level_h] = pixels[(x * w / level_w) + (y * h / level_h) * w];
+
+	// Every other level is the one before it, shrunk by half with a box filter
+	for (int level = 1; level < texture.levels; level++) {
+		int last_w = level_w, last_h = level_h;
+		uint32_t* last = &atlas->pixels[texture.offset[level - 1]];
+		uint32_t* next = &atlas->pixels[texture.offset[level]];
+		level_w = MAX(level_w / 2, 1);
+		level_h = MAX(level_h / 2, 1);
+		for (int x = 0; x < level_w; x++) {
+			for (int y = 0; y < level_h; y++) {
+				int x0 = MIN(x * 2, last_w - 1), x1 = MIN(x * 2 + 1, last_w - 1);
+				int y0 = MIN(y * 2, last_h - 1), y1 = MIN(y * 2 + 1, last_h - 1);
+				next[y + x * level_h] = average_pixels(
+					last[y0 + x0 * last_h], last[y1 + x0 * last_h],
+					last[y0 + x1 * last_h], last[y1 + x1 * last_h]
+				);
+			}
+		}
+	}
+
+	atlas->length += size;
+	atlas->textures[atlas->count] = texture;
+	return atlas->count++;
+}
+
+int texture_atlas_add_placeholder(TextureAtlas* atlas, int seed) {
+	// Pick a color from the seed, so diffrent missing textures can be told apart
+	uint32_t r = (seed * 97 + 64) & 0xff, g = (seed * 57 + 128) & 0xff, b = (seed * 31 + 192) & 0xff;
+	uint32_t color = r << 24 | g << 16 | b << 8 | 0xff;
+	uint32_t pixels[64 * 64];
+	for (int y = 0; y < 64; y++)
+		for (int x = 0; x < 64; x++)
+			pixels[x + y * 64] = (x / 8 + y / 8) % 2 ? color : 0x202020ff;
+	return texture_atlas_add(atlas, pixels, 64, 64);
+}
+
+void load_map_textures(struct Map* map, ImageLoader load_image) {
+	texture_atlas_free(map->textures);
+	map->textures = texture_atlas_create();
+	for (int i = 0; i < map->texture_count; i++) {
+		int w, h;
+		uint32_t* pixels = load_image ? load_image(map->texture_paths[i], &w, &h) : NULL;
+		if (pixels) {
+			texture_atlas_add(map->textures, pixels, w, h);
+			free(pixels);
+		} else {
+			texture_atlas_add_placeholder(map->textures, i);
+		}
+	}
+	map_changed(map);
+}
+
+// Find the texels of the texture column to draw a vertical line with, for textured_vline and sprite_vline.
+// The 16.16 fixed point texture row of the first pixel, how much it steps every pixel, and the mask to wrap it with are set too.
+uint32_t* vline_texels(
+	int y0, float y0_orig, float y1_orig, float texture_x, float texture_y0, float texture_y1,
+	TextureAtlas* atlas, int texture_index, uint32_t* v, uint32_t* v_step, uint32_t* v_mask
+) {
+	struct Texture* texture = &atlas->textures[texture_index];
+
+	// Pick the mip level where one pixel steps about one texel, from how far apart the texture's rows are on screen
+	float texels_per_pixel = fabsf(texture_y1 - texture_y0) * (1 << texture->h_log2) / MAX(y1_orig - y0_orig, 1);
+	int level = MIN(MAX(ilogbf(texels_per_pixel), 0), texture->levels - 1);
+	int w_log2 = MAX(texture->w_log2 - level, 0);
+	int h_log2 = MAX(texture->h_log2 - level, 0);
+	uint32_t h_mask = (1 << h_log2) - 1;
+
+	// Find the texture column, wrapping with a mask since the size is a power of two
+	uint32_t texture_column = (uint32_t)(int32_t)floorf(texture_x * (1 << w_log2)) & ((1 << w_log2) - 1);
+
+	// Step down the texture in 16.16 fixed point, starting from the center of the first pixel
+	float texel_y0 = texture_y0 * (1 << h_log2);
+	float step = (texture_y1 - texture_y0) * (1 << h_log2) / (y1_orig - y0_orig);
+	*v = (uint32_t)(int64_t)((texel_y0 + (y0 + 0.5f - y0_orig) * step) * 65536);
+	*v_step = (uint32_t)(int64_t)(step * 65536);
+	*v_mask = h_mask;
+	return &atlas->pixels[texture->offset[level] + ((size_t)texture_column << h_log2)];
+}
+
+void textured_vline(
+	uint32_t* column, int y0, int y1,
+	float y0_orig, float y1_orig, float texture_x, float texture_y0, float texture_y1,
+	TextureAtlas* atlas, int texture_index, const uint8_t* colormap
+) {
+	if (y0 >= y1) return;
+	uint32_t v, v_step, h_mask;
+	uint32_t* texels = vline_texels(y0, y0_orig, y1_orig, texture_x, texture_y0, texture_y1, atlas, texture_index, &v, &v_step, &h_mask);
+	for (int y = y0; y < y1; y++) {
+		column[y] = light_pixel(colormap, texels[(v >> 16) & h_mask]);
+		v += v_step;
+	}
+}
+
+int sprite_vline(
+	uint32_t* column, int y0, int y1, float y0_orig, float y1_orig, float texture_x,
+	TextureAtlas* atlas, int texture_index, const uint8_t* colormap
+) {
+	if (y0 >= y1) return 0;
+	uint32_t v, v_step, h_mask;
+	uint32_t* texels = vline_texels(y0, y0_orig, y1_orig, texture_x, 0, 1, atlas, texture_index, &v, &v_step, &h_mask);
+	int drawn = 0;
+	for (int y = y0; y < y1; y++) {
+		uint32_t texel = texels[(v >> 16) & h_mask];
+		if ((texel & 0xff) >= 0x80) {
+			column[y] = light_pixel(colormap, texel);
+			drawn++;
+		}
+		v += v_step;
+	}
+	return drawn;
+}
+
+void textured_hspan(
+	uint32_t* pixels, int stride, int skip, int length,
+	float u, float v, float u_step, float v_step,
+	TextureAtlas* atlas, int texture_index, const uint8_t* colormap
+) {
+	if (length <= 0) return;
+	struct Texture* texture = &atlas->textures[texture_index];
+
+	// Pick the mip level from how many texels one pixel steps across
+	float texels_per_pixel = MAX(fabsf(u_step) * (1 << texture->w_log2), fabsf(v_step) * (1 << texture->h_log2));
+	int level = MIN(MAX(ilogbf(texels_per_pixel), 0), texture->levels - 1);
+	int w_log2 = MAX(texture->w_log2 - level, 0);
+	int h_log2 = MAX(texture->h_log2 - level, 0);
+	uint32_t w_mask = (1 << w_log2) - 1, h_mask = (1 << h_log2) - 1;
+	uint32_t* texels = &atlas->pixels[texture->offset[level]];
+
+	// Step in 16.16 fixed point, only the fraction of a repeat is kept so large cordinates don't overflow.
+	// Overflowing while stepping is fine, it wraps by a whole number of repeats.
+	uint32_t u_fixed = (uint32_t)(int64_t)((u - floorf(u)) * (1 << w_log2) * 65536);
+	uint32_t v_fixed = (uint32_t)(int64_t)((v - floorf(v)) * (1 << h_log2) * 65536);
+	uint32_t u_fixed_step = (uint32_t)(int64_t)(u_step * (1 << w_log2) * 65536);
+	uint32_t v_fixed_step = (uint32_t)(int64_t)(v_step * (1 << h_log2) * 65536);
+	u_fixed += u_fixed_step * (uint32_t)skip;
+	v_fixed += v_fixed_step * (uint32_t)skip;
+	for (int i = 0; i < length; i++) {
+		pixels[i * stride] = light_pixel(colormap, texels[((v_fixed >> 16) & h_mask) + (((u_fixed >> 16) & w_mask) << h_log2)]);
+		u_fixed += u_fixed_step;
+		v_fixed += v_fixed_step;
+	}
+}
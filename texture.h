@@ -0,0 +1,76 @@
+// Textures
+// Every texture is stored in one block of memory, the atlas, resized to a power of two size so texture cordinates can be wrapped with a mask.
+// Each texture has a chain of mipmaps, each half the size of the last, so far away walls sample from a small, cache friendly image.
+// Like the canvas, texture pixels are stored column by column, since walls are drawn in vertical lines.
+#pragma once
+
+#include <stdint.h>
+#include "map.h"
+
+// Textures are scaled up to at most this size
+#define TEXTURE_MAX_LOG2 10
+#define TEXTURE_MAX_LEVELS (TEXTURE_MAX_LOG2 + 1)
+
+struct Texture {
+	// Number of mipmap levels, level 0 is full size
+	int levels;
+	// Size of level 0, as powers of two
+	int w_log2, h_log2;
+	// Where each level starts in the atlas
+	size_t offset[TEXTURE_MAX_LEVELS];
+};
+
+typedef struct TextureAtlas {
+	uint32_t* pixels;
+	size_t length;
+	int count;
+	struct Texture* textures;
+} TextureAtlas;
+
+TextureAtlas* texture_atlas_create();
+
+void texture_atlas_free(TextureAtlas* atlas);
+
+// Add a texture from RGBA8888 pixels stored row by row, returns its index.
+int texture_atlas_add(TextureAtlas* atlas, const uint32_t* pixels, int w, int h);
+
+// Add a checkerboard, used when a texture can't be loaded, returns its index.
+int texture_atlas_add_placeholder(TextureAtlas* atlas, int seed);
+
+// Function to load an image file into RGBA8888 pixels stored row by row, allocated with malloc.
+// Returns NULL if the image can't be loaded.
+typedef uint32_t* (*ImageLoader)(const char* path, int* w, int* h);
+
+// Load every texture listed in the map with load_image, and store them in map->textures.
+// Textures that fail to load, or all of them if load_image is NULL, are replaced with placeholders.
+void load_map_textures(struct Map* map, ImageLoader load_image);
+
+// Draw a column of a texture
+// x, y0, and y1 are the phisical area of the line
+// texture_x is the horisontal texture cordinate, and texture_y0 and texture_y1 are the vertical cordinates at y0_orig and y1_orig.
+// Texture cordinates are in texture repeats, so 0 to 1 covers the texture once.
+// y0_orig and y1_orig are the unclipped ends of the line, so the line can be clipped while preserving texture layout.
+// Every texel is shaded with colormap, one of the colormaps in light.h.
+void textured_vline(
+	uint32_t* column, int y0, int y1,
+	float y0_orig, float y1_orig, float texture_x, float texture_y0, float texture_y1,
+	TextureAtlas* atlas, int texture, const uint8_t* colormap
+);
+
+// Draw a column of a sprite, like textured_vline but the texture covers y0_orig to y1_orig once, and doesn't repeat.
+// Texels with an alpha under half are see through, and are skipped. Returns the number of pixels drawn.
+int sprite_vline(
+	uint32_t* column, int y0, int y1, float y0_orig, float y1_orig, float texture_x,
+	TextureAtlas* atlas, int texture, const uint8_t* colormap
+);
+
+// Draw a horizontal span of a texture, for floors and ceilings
+// pixels is the first pixel of the span, and stride is how far apart pixels next to each other are.
+// u and v are the texture cordinates of the pixel skip pixels before the first one, and change by u_step and v_step every pixel.
+// Spans on the same row, with the same u and v, line up exactly however the row is split up.
+// Like textured_vline, texels are shaded with colormap.
+void textured_hspan(
+	uint32_t* pixels, int stride, int skip, int length,
+	float u, float v, float u_step, float v_step,
+	TextureAtlas* atlas, int texture, const uint8_t* colormap
+);